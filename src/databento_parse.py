@@ -8,13 +8,38 @@ import databento as db
 import databento_dbn as dbn
 import databento_classes
 
+def read_roll_schedule(filename = "roll_schedule.csv"):
+    """symbol -> (start, end) in unix seconds; the same file is read by model/Symbology.h."""
+    schedule = dict()
+    with open(filename) as f:
+        for line in f:
+            if line.strip() and not line.startswith('#'):
+                symbol, start, end = line.strip().split(',')[:3]
+                schedule[symbol] = (float(start), float(end))
+    return schedule
+
+def is_scheduled(schedule, instrument, timestamp):
+    start, end = schedule.get(instrument, (0, 0))
+    return start <= timestamp < end
+
+def write_symbology(datastores, output_file):
+    """Per-file instrument_id,symbol,start,end mappings for model/Symbology.h."""
+    with open(output_file, 'w') as f:
+        f.write('instrument_id,symbol,start,end\n')
+        for symbol, intervals in [item for data in datastores for item in data.metadata.mappings.items()]:
+            for interval in intervals:
+                start = datetime.datetime.combine(interval['start_date'], datetime.time(), datetime.timezone.utc).timestamp()
+                end = datetime.datetime.combine(interval['end_date'], datetime.time(), datetime.timezone.utc).timestamp()
+                f.write(f"{interval['symbol']},{symbol},{start},{end}\n")
+
 def parse_folder(data_path = "../data/databento/es/ftp.databento.com/E8XGYL35/GLBX-20241008-8PTR93CRA9/"):
     for file in sorted(glob.glob(data_path+'*.zst')):
         for result in parse_file(file):
             yield result
 
 def parse_file(file = "../data/databento/es/ftp.databento.com/E8XGYL35/GLBX-20241008-8PTR93CRA9/glbx-mdp3-20240904.mbo.dbn.zst"):
-    data = db.DBNStore.from_file(file)
+    # Accepts an already opened store, so callers that also need its metadata only decode the header once.
+    data = file if isinstance(file, db.DBNStore) else db.DBNStore.from_file(file)
 
     market = databento_classes.Market()
 
@@ -24,7 +49,7 @@ def parse_file(file = "../data/databento/es/ftp.databento.com/E8XGYL35/GLBX-2024
 
     start = data.metadata.start
 
-    cutoff = 1726916400
+    schedule = read_roll_schedule()
     for mbo in data:
         market.apply(mbo)
 
@@ -38,10 +63,7 @@ def parse_file(file = "../data/databento/es/ftp.databento.com/E8XGYL35/GLBX-2024
             else:
                 instrument = None
 
-        is_sept_expiry = instrument in ('MESU4','ESU4')
-        is_dec_expiry = instrument in ('MESZ4','ESZ4')
-
-        if (mbo.ts_event * 1e-9 < cutoff and is_sept_expiry) or (mbo.ts_event * 1e-9 > cutoff and is_dec_expiry):
+        if is_scheduled(schedule, instrument, mbo.ts_event * 1e-9):
             if data.metadata.start <= mbo.ts_event <= data.metadata.end:
                 yield (mbo,market,instrument[:-2],(mbo.ts_event-start)*1e-9)
         """
@@ -96,12 +118,13 @@ if __name__ == "__main__":
     print(filenames)
     for filename in tqdm.tqdm(filenames):
         print('Start',filename)
-        mbos = interleave([parse_file(folder+filename) for folder in folders])
+        datastores = [db.DBNStore.from_file(folder+filename) for folder in folders]
+        mbos = interleave([parse_file(data) for data in datastores])
         output_file = '../output/databento/'+filename.split('.')[0]+'.csv'
-        datastores = {db.DBNStore.from_file(folder+filename) for folder in folders}
         bounds = {(data.metadata.start,data.metadata.end) for data in datastores}
         assert len(bounds) == 1, (filename,bounds)
         bounds = list(bounds)[0]
+        write_symbology(datastores, output_file.replace('.csv','.symbology.csv'))
         with open(output_file,'w') as f:
             f.write(f'{bounds[0]},{bounds[1]}\n')
             write_csv(tqdm.tqdm(mbos), f)
@@ -2,7 +2,7 @@
 import databento as db
 import glob
 import tqdm
-from databento_parse import interleave
+from databento_parse import interleave, read_roll_schedule, is_scheduled
 import databento_classes
 import databento_dbn as dbn
 import datetime
@@ -15,18 +15,18 @@ def parse_file(filename):
     instrument_map = db.common.symbology.InstrumentMap()
     instrument_map.insert_metadata(data.metadata)
 
-    cutoff = 1726916400
+    schedule = read_roll_schedule()
+    instrument_codes = dict()
     for mbo in data:
         market.apply(mbo)
 
         timestamp = mbo.ts_event * 1e-9
 
-        instrument = instrument_map.resolve(mbo.instrument_id, datetime.datetime.fromtimestamp(mbo.ts_event*1e-9).date())
+        if mbo.instrument_id not in instrument_codes:
+            instrument_codes[mbo.instrument_id] = instrument_map.resolve(mbo.instrument_id, datetime.datetime.fromtimestamp(timestamp).date())
+        instrument = instrument_codes[mbo.instrument_id]
 
-        is_sept_expiry = instrument in ('MESU4','ESU4')
-        is_dec_expiry = instrument in ('MESZ4','ESZ4')
-
-        if (mbo.ts_event * 1e-9 < cutoff and is_sept_expiry) or (mbo.ts_event * 1e-9 > cutoff and is_dec_expiry):
+        if is_scheduled(schedule, instrument, timestamp):
             if mbo.action == 'T':
                 yield (mbo,market,instrument[:-2])
 
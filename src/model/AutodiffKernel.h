@@ -0,0 +1,302 @@
+#ifndef AUTODIFFKERNEL_H
+#define AUTODIFFKERNEL_H
+
+#include <vector>
+#include <cmath>
+#include <optional>
+#include <cassert>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+#include "Kernel.h"
+#include "Dual.h"
+#include "Seasonality.h"
+
+/*
+ * Kernel whose Hessian and gradient come from running its own recursion on HyperDual scalars.
+ * Intensities are split into one block per target event type, each with BlockSize parameters and its own recursive state,
+ * so the log-likelihood and its derivatives are accumulated per block and the Hessian is block diagonal.
+ * Derived classes (CRTP) only write the recursion, templated on the scalar type:
+ *	template <typename S> S advance(int block, const std::vector<S>& params, std::vector<S>& state, REAL time, REAL timediff)
+ *		decays the state from time to time + timediff and returns the integral of the block's intensity over that interval
+ *	template <typename S> S intensity(int block, const std::vector<S>& params, const std::vector<S>& state, REAL time)
+ *	template <typename S> void excite(int block, const std::vector<S>& params, std::vector<S>& state, const Event& observation, REAL weight)
+ * and set state_size and the initial coef in their constructor.
+ * Backgrounds should be written as a level times background_value/background_integral, so that a fitted
+ * SeasonalProfile can be composed in with set_background_profile without changing the kernel.
+ */
+template <class Derived, int BlockSize>
+class AutodiffKernel : public Kernel {
+	public:
+		using Scalar = HyperDual<BlockSize>;
+
+		AutodiffKernel(int num_event_types, REAL start_time, REAL end_time, int state_size) : Kernel(num_event_types, start_time, end_time), state_size(state_size) {
+			coef = Eigen::MatrixXd::Constant(BlockSize, num_event_types, 0.0);
+		}
+
+		std::pair<Eigen::MatrixXd,Eigen::VectorXd> get_hessian_and_gradient() {
+			auto [hessian, gradient] = get_structured_hessian_and_gradient();
+			return {hessian.to_dense(), gradient};
+		}
+
+		std::pair<StructuredHessian,Eigen::VectorXd> get_structured_hessian_and_gradient() {
+			int num_params = coef.size();
+			Eigen::VectorXd gradient(num_params);
+			Eigen::MatrixXd hessian(BlockSize, num_params);
+			for (int b = 0; b < num_event_types; b++) {
+				Scalar total = block_log_likelihood(b);
+				//Fixed-size views, so a 1x1 block is copied as a scalar rather than through a two-double packet load that GCC
+				//flags as reading past the end of the HyperDual (-Warray-bounds).
+				gradient.template segment<BlockSize>(b * BlockSize) = total.gradient;
+				hessian.template block<BlockSize, BlockSize>(0, b * BlockSize) = total.hessian;
+			}
+			return {StructuredHessian::block_diagonal(BlockSize, hessian), gradient};
+		}
+
+		REAL get_log_likelihood() {
+			REAL total = 0;
+			for (int b = 0; b < num_event_types; b++) {
+				total += block_log_likelihood(b).value;
+			}
+			return total;
+		}
+
+		Eigen::VectorXd get_params() {
+			return Eigen::Map<Eigen::VectorXd>(coef.data(), coef.size());
+		}
+
+		void set_params(Eigen::VectorXd new_params) {
+			coef = Eigen::Map<Eigen::MatrixXd>(new_params.data(), BlockSize, num_event_types);
+			seed_params();
+		}
+
+		Eigen::VectorXd get_intensities() {
+			Eigen::VectorXd intensities(num_event_types);
+			for (int b = 0; b < num_event_types; b++) {
+				std::vector<Scalar> current_state = state[b];
+				derived().advance(b, seeded_params[b], current_state, block_time[b], current_time - block_time[b]);
+				intensities[b] = derived().intensity(b, seeded_params[b], current_state, current_time).value;
+			}
+			return intensities;
+		}
+
+		Eigen::VectorXd get_compensators() {
+			Eigen::VectorXd compensators = Eigen::Map<Eigen::VectorXd>(compensator.data(), num_event_types);
+			for (int b = 0; b < num_event_types; b++) {
+				if (current_time > block_time[b]) {
+					std::vector<Scalar> current_state = state[b];
+					compensators[b] += derived().advance(b, seeded_params[b], current_state, block_time[b], current_time - block_time[b]).value;
+				}
+			}
+			return compensators;
+		}
+
+		void update(Event observation, REAL weight=1.0) {
+			for (int b = 0; b < num_event_types; b++) {
+				//Without recursive state a block's intensity only depends on time, so it is advanced lazily when it is next observed.
+				if (state_size == 0 && b != observation.event_type) {
+					continue;
+				}
+				advance_block(b, observation.time);
+				if (weight != 0 && b == observation.event_type) {
+					log_likelihood[b] += log(derived().intensity(b, seeded_params[b], state[b], observation.time)) * (double)weight;
+				}
+				if (weight != 0) {
+					derived().excite(b, seeded_params[b], state[b], observation, weight);
+				}
+			}
+			progress_time(observation.time - current_time);
+		}
+
+		void discount(REAL factor) {
+			for (int b = 0; b < num_event_types; b++) {
+				advance_block(b, current_time);
+				log_likelihood[b] *= (double)factor;
+			}
+		}
+
+		REAL get_intensity_upper_bound() {
+			//Only valid for kernels whose intensity is non-increasing between events.
+			return get_intensities().cwiseMax(0.0).sum();
+		}
+
+		void reset() {
+			current_time = start_time;
+			block_time.assign(num_event_types, start_time);
+			compensator.assign(num_event_types, 0.0);
+			seed_params();
+			log_likelihood.assign(num_event_types, Scalar(0.0));
+			state.assign(num_event_types, std::vector<Scalar>(state_size, Scalar(0.0)));
+		};
+
+		void set_background_profile(SeasonalProfile profile) {
+			background_profile = profile;
+		}
+
+	protected:
+		//Shape of the background over [time, time + timediff]; flat unless a seasonal profile has been set.
+		REAL background_integral(int block, REAL time, REAL timediff) const {
+			return background_profile ? background_profile->integral(block, time, time + timediff) : timediff;
+		}
+
+		REAL background_value(int block, REAL time) const {
+			return background_profile ? background_profile->value(block, time) : 1.0;
+		}
+
+		//Value of a block's recursive state as of its last update, for evaluation without derivatives.
+		double block_state_value(int block, int k) const {
+			return state[block][k].value;
+		}
+
+		REAL block_update_time(int block) const {
+			return block_time[block];
+		}
+
+		Eigen::MatrixXd coef;
+		int state_size;
+		std::optional<SeasonalProfile> background_profile;
+
+	private:
+		Derived& derived() {
+			return static_cast<Derived&>(*this);
+		}
+
+		//Includes the session tail from the block's last update to end_time.
+		Scalar block_log_likelihood(int b) {
+			Scalar total = log_likelihood[b];
+			if (end_time > block_time[b]) {
+				std::vector<Scalar> tail_state = state[b];
+				total -= derived().advance(b, seeded_params[b], tail_state, block_time[b], end_time - block_time[b]);
+			}
+			return total;
+		}
+
+		void advance_block(int b, REAL time) {
+			if (time > block_time[b]) {
+				Scalar integral = derived().advance(b, seeded_params[b], state[b], block_time[b], time - block_time[b]);
+				log_likelihood[b] -= integral;
+				compensator[b] += integral.value;
+				block_time[b] = time;
+			}
+		}
+
+		//Each block's parameters become independent variables of that block's dual numbers.
+		void seed_params() {
+			seeded_params.assign(num_event_types, std::vector<Scalar>());
+			for (int b = 0; b < num_event_types; b++) {
+				for (int k = 0; k < BlockSize; k++) {
+					seeded_params[b].push_back(Scalar::variable(coef(k, b), k));
+				}
+			}
+		}
+
+		std::vector<REAL> block_time;
+		std::vector<double> compensator;
+		std::vector<std::vector<Scalar>> seeded_params, state;
+		std::vector<Scalar> log_likelihood;
+};
+
+//Poisson process written against the autodiff interface; homogeneous unless a background profile is set.
+class AutodiffPoissonKernel : public AutodiffKernel<AutodiffPoissonKernel, 1> {
+	public:
+		AutodiffPoissonKernel(int num_event_types, REAL start_time, REAL end_time) : AutodiffKernel(num_event_types, start_time, end_time, 0) {
+			coef.row(0) = Eigen::VectorXd::Random(num_event_types).transpose().array() + 2.0;
+			reset();
+		}
+
+		Eigen::VectorXd get_lower_bounds() {
+			return Eigen::VectorXd::Constant(coef.size(), 0.0);
+		}
+
+		template <typename S>
+		S advance(int block, const std::vector<S>& params, std::vector<S>& /*state*/, REAL time, REAL timediff) {
+			return params[0] * (double)background_integral(block, time, timediff);
+		}
+
+		template <typename S>
+		S intensity(int block, const std::vector<S>& params, const std::vector<S>& /*state*/, REAL time) {
+			return params[0] * (double)background_value(block, time);
+		}
+
+		template <typename S>
+		void excite(int /*block*/, const std::vector<S>& /*params*/, std::vector<S>& /*state*/, const Event& /*observation*/, REAL /*weight*/) {
+		}
+};
+
+/*
+ * Multivariate exponential Hawkes process with a separate decay per (target, source) pair.
+ * Block i holds [nu_i, alpha_{i,0..D-1}, beta_{i,0..D-1}] and its state holds the decayed event counts R_{i,j}.
+ */
+template <int D>
+class AutodiffExpHawkesKernel : public AutodiffKernel<AutodiffExpHawkesKernel<D>, 1 + 2 * D> {
+	public:
+		using Base = AutodiffKernel<AutodiffExpHawkesKernel<D>, 1 + 2 * D>;
+
+		AutodiffExpHawkesKernel(REAL start_time, REAL end_time) : Base(D, start_time, end_time, D) {
+			Eigen::MatrixXd beta = Eigen::MatrixXd::Random(D, D).array() + 2.0;
+			this->coef.row(0) = Eigen::VectorXd::Random(D).transpose().array() + 2.0;
+			this->coef.middleRows(1, D) = 0.5 * beta / D;
+			this->coef.bottomRows(D) = beta;
+			this->reset();
+		}
+
+		//Rates, excitations and decays are all non-negative, which keeps the intensity positive.
+		Eigen::VectorXd get_lower_bounds() {
+			return Eigen::VectorXd::Constant(this->coef.size(), 0.0);
+		}
+
+		//Plain doubles instead of dual numbers: each block's excitation at a query is its current value times a
+		//queries x D matrix of exp(-beta_j * offset), so a run of queries is one matrix-vector product per block.
+		void get_intensities_at(const Eigen::VectorXd& offsets, Eigen::Ref<Eigen::MatrixXd> out) {
+			assert((offsets.array() >= 0).all());
+			for (int b = 0; b < D; b++) {
+				auto block = this->coef.col(b);
+				Eigen::VectorXd beta = block.tail(D);
+				REAL since_update = this->current_time - this->block_update_time(b);
+				Eigen::VectorXd excitation(D);
+				for (int j = 0; j < D; j++) {
+					excitation[j] = block[1 + j] * this->block_state_value(b, j) * std::exp(-beta[j] * (double)since_update);
+				}
+				Eigen::MatrixXd decay = (-(offsets * beta.transpose()).array()).exp().matrix();
+				out.col(b).noalias() = decay * excitation;
+				if (this->background_profile) {
+					for (int k = 0; k < offsets.size(); k++) {
+						out(k, b) += block[0] * (double)this->background_value(b, this->current_time + offsets[k]);
+					}
+				} else {
+					out.col(b).array() += block[0];
+				}
+			}
+		}
+
+		template <typename S>
+		S advance(int block, const std::vector<S>& params, std::vector<S>& state, REAL time, REAL timediff) {
+			using std::exp;
+			S integral = params[0] * (double)this->background_integral(block, time, timediff);
+			for (int j = 0; j < D; j++) {
+				const S& alpha = params[1 + j];
+				const S& beta = params[1 + D + j];
+				S decay = exp(beta * -(double)timediff);
+				integral += alpha * state[j] * (1.0 - decay) / beta;
+				state[j] = state[j] * decay;
+			}
+			return integral;
+		}
+
+		template <typename S>
+		S intensity(int block, const std::vector<S>& params, const std::vector<S>& state, REAL time) {
+			S total = params[0] * (double)this->background_value(block, time);
+			for (int j = 0; j < D; j++) {
+				total += params[1 + j] * state[j];
+			}
+			return total;
+		}
+
+		template <typename S>
+		void excite(int /*block*/, const std::vector<S>& /*params*/, std::vector<S>& state, const Event& observation, REAL weight) {
+			state[observation.event_type] += (double)weight;
+		}
+};
+
+#endif //AUTODIFFKERNEL_H
@@ -0,0 +1,178 @@
+#ifndef BATCHLIKELIHOOD_H
+#define BATCHLIKELIHOOD_H
+
+#include <cmath>
+#include <cassert>
+#include <optional>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+#include "Seasonality.h"
+
+/*
+ * Log-likelihood (and optionally its gradient) of the exponential Hawkes model of AutodiffExpHawkesKernel<D> for
+ * K candidate parameter vectors in a single pass over the events, for grid searches over decays and multi-start fits.
+ * candidates is num_params x K, each column laid out like AutodiffExpHawkesKernel::get_params(), i.e. block i holds
+ * [nu_i, alpha_{i,0..D-1}, beta_{i,0..D-1}], so the best column can be handed straight to set_params and the Optimizer.
+ * All recursive state is stored structure-of-arrays: one K x (D*D) array per quantity whose column (i, j) is contiguous
+ * across candidates, so each event decays and excites every candidate with a handful of vectorised column operations
+ * and the pass costs roughly one read of the events rather than K. Decays must be positive.
+ */
+class BatchExpHawkesLikelihood {
+	public:
+		BatchExpHawkesLikelihood(int num_event_types, REAL start_time, REAL end_time, const Eigen::MatrixXd& candidates, bool with_gradient=false) : num_event_types(num_event_types), num_candidates(candidates.cols()), start_time(start_time), end_time(end_time), with_gradient(with_gradient) {
+			int d = num_event_types;
+			assert(candidates.rows() == d * (1 + 2 * d));
+			nu.resize(num_candidates, d);
+			alpha.resize(num_candidates, d * d);
+			beta.resize(num_candidates, d * d);
+			for (int i = 0; i < d; i++) {
+				int block = i * (1 + 2 * d);
+				nu.col(i) = candidates.row(block).transpose();
+				for (int j = 0; j < d; j++) {
+					alpha.col(cell(i, j)) = candidates.row(block + 1 + j).transpose();
+					beta.col(cell(i, j)) = candidates.row(block + 1 + d + j).transpose();
+				}
+			}
+			reset();
+		}
+
+		void reset() {
+			int d = num_event_types;
+			current_time = start_time;
+			excitation = Eigen::ArrayXXd::Zero(num_candidates, d * d);
+			log_intensity_sum = Eigen::ArrayXd::Zero(num_candidates);
+			compensator = Eigen::ArrayXd::Zero(num_candidates);
+			if (with_gradient) {
+				excitation_beta_derivative = Eigen::ArrayXXd::Zero(num_candidates, d * d);
+				nu_gradient = Eigen::ArrayXXd::Zero(num_candidates, d);
+				alpha_gradient = Eigen::ArrayXXd::Zero(num_candidates, d * d);
+				beta_gradient = Eigen::ArrayXXd::Zero(num_candidates, d * d);
+			}
+		}
+
+		void update(const Event& observation, REAL weight=1.0) {
+			advance(excitation, excitation_beta_derivative, compensator, nu_gradient, alpha_gradient, beta_gradient, current_time, observation.time - current_time);
+			current_time = observation.time;
+			if (weight == 0) {
+				return;
+			}
+
+			int d = num_event_types;
+			int k = observation.event_type;
+			double w = weight;
+			intensity = nu.col(k) * background_value(k, current_time);
+			for (int j = 0; j < d; j++) {
+				intensity += alpha.col(cell(k, j)) * excitation.col(cell(k, j));
+			}
+			log_intensity_sum += w * intensity.log();
+
+			if (with_gradient) {
+				//d log(lambda)/d theta = (d lambda/d theta) / lambda; the buffer now holds w / lambda.
+				intensity = w / intensity;
+				nu_gradient.col(k) += intensity * background_value(k, current_time);
+				for (int j = 0; j < d; j++) {
+					alpha_gradient.col(cell(k, j)) += intensity * excitation.col(cell(k, j));
+					beta_gradient.col(cell(k, j)) += intensity * alpha.col(cell(k, j)) * excitation_beta_derivative.col(cell(k, j));
+				}
+			}
+			for (int i = 0; i < d; i++) {
+				excitation.col(cell(i, k)) += w;
+			}
+		}
+
+		//Log-likelihood of each candidate over [start_time, end_time], including the tail after the last event.
+		Eigen::VectorXd get_log_likelihoods() {
+			Eigen::ArrayXXd tail_excitation = excitation, tail_derivative, tail_nu, tail_alpha, tail_beta;
+			Eigen::ArrayXd tail_compensator = compensator;
+			advance(tail_excitation, tail_derivative, tail_compensator, tail_nu, tail_alpha, tail_beta, current_time, end_time - current_time, false);
+			return (log_intensity_sum - tail_compensator).matrix();
+		}
+
+		//num_params x K, each column laid out like the candidates; requires with_gradient.
+		Eigen::MatrixXd get_gradients() {
+			assert(with_gradient);
+			int d = num_event_types;
+			Eigen::ArrayXXd tail_excitation = excitation, tail_derivative = excitation_beta_derivative;
+			Eigen::ArrayXXd tail_nu = nu_gradient, tail_alpha = alpha_gradient, tail_beta = beta_gradient;
+			Eigen::ArrayXd tail_compensator = compensator;
+			advance(tail_excitation, tail_derivative, tail_compensator, tail_nu, tail_alpha, tail_beta, current_time, end_time - current_time);
+
+			Eigen::MatrixXd gradients(d * (1 + 2 * d), num_candidates);
+			for (int i = 0; i < d; i++) {
+				int block = i * (1 + 2 * d);
+				gradients.row(block) = tail_nu.col(i).transpose();
+				for (int j = 0; j < d; j++) {
+					gradients.row(block + 1 + j) = tail_alpha.col(cell(i, j)).transpose();
+					gradients.row(block + 1 + d + j) = tail_beta.col(cell(i, j)).transpose();
+				}
+			}
+			return gradients;
+		}
+
+		void set_background_profile(SeasonalProfile profile) {
+			background_profile = profile;
+		}
+
+		int num_event_types, num_candidates;
+		REAL start_time, end_time, current_time;
+
+	private:
+		int cell(int target, int source) const {
+			return target * num_event_types + source;
+		}
+
+		double background_value(int target, REAL time) const {
+			return background_profile ? (double)background_profile->value(target, time) : 1.0;
+		}
+
+		double background_integral(int target, REAL time, REAL timediff) const {
+			return background_profile ? (double)background_profile->integral(target, time, time + timediff) : (double)timediff;
+		}
+
+		/*
+		 * Decays the excitations over [time, time + timediff], adding the integrated intensity to the compensator and
+		 * subtracting its derivatives from the gradients. With alpha R e^{-beta s} as the (i, j) term, E = e^{-beta dt}:
+		 *	integral = alpha R (1 - E) / beta
+		 *	d/dbeta carries R' = dR/dbeta forward as E (R' - dt R)
+		 */
+		void advance(Eigen::ArrayXXd& excitation, Eigen::ArrayXXd& derivative, Eigen::ArrayXd& compensator, Eigen::ArrayXXd& nu_gradient, Eigen::ArrayXXd& alpha_gradient, Eigen::ArrayXXd& beta_gradient, REAL time, REAL timediff, bool gradient=true) const {
+			if (timediff <= 0) {
+				return;
+			}
+			int d = num_event_types;
+			double dt = timediff;
+			gradient = gradient && with_gradient;
+			for (int i = 0; i < d; i++) {
+				double background = background_integral(i, time, timediff);
+				compensator += nu.col(i) * background;
+				if (gradient) {
+					nu_gradient.col(i) -= background;
+				}
+				for (int j = 0; j < d; j++) {
+					int c = cell(i, j);
+					decay = (-dt * beta.col(c)).exp();
+					fraction = (1 - decay) / beta.col(c);
+					compensator += alpha.col(c) * excitation.col(c) * fraction;
+					if (gradient) {
+						alpha_gradient.col(c) -= excitation.col(c) * fraction;
+						beta_gradient.col(c) -= alpha.col(c) * (derivative.col(c) * fraction + excitation.col(c) * (dt * decay - fraction) / beta.col(c));
+						derivative.col(c) = decay * (derivative.col(c) - dt * excitation.col(c));
+					}
+					excitation.col(c) *= decay;
+				}
+			}
+		}
+
+		bool with_gradient;
+		std::optional<SeasonalProfile> background_profile;
+		Eigen::ArrayXXd nu, alpha, beta;
+		Eigen::ArrayXXd excitation, excitation_beta_derivative;
+		Eigen::ArrayXd log_intensity_sum, compensator;
+		Eigen::ArrayXXd nu_gradient, alpha_gradient, beta_gradient;
+		//Per-event scratch, kept so the event loop does not allocate.
+		mutable Eigen::ArrayXd decay, fraction, intensity;
+};
+
+#endif //BATCHLIKELIHOOD_H
@@ -0,0 +1,333 @@
+#ifndef BINNING_H
+#define BINNING_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+#include "Parse.h"
+#include "Catalog.h"
+
+/*
+ * Columns of a binned count matrix: for each instrument, one count column per event type followed by its signed
+ * traded volume (trade size, positive when the aggressor bought). Events of other instruments are ignored.
+ */
+struct BinningLayout {
+	std::vector<std::string> instruments;
+	REAL bin_width = 1;
+	int num_types = num_order_event_types;
+
+	int num_columns() const {
+		return instruments.size() * (num_types + 1);
+	}
+
+	int count_column(int instrument, int event_type) const {
+		return instrument * (num_types + 1) + event_type;
+	}
+
+	int volume_column(int instrument) const {
+		return instrument * (num_types + 1) + num_types;
+	}
+
+	int instrument_index(std::string_view instrument) const {
+		for (size_t i = 0; i < instruments.size(); i++) {
+			if (instruments[i] == instrument) {
+				return i;
+			}
+		}
+		return -1;
+	}
+
+	std::vector<std::string> column_names() const {
+		std::vector<std::string> names;
+		for (const std::string& instrument : instruments) {
+			for (int type = 0; type < num_types; type++) {
+				names.push_back(instrument + "_" + std::to_string(type));
+			}
+			names.push_back(instrument + "_signed_volume");
+		}
+		return names;
+	}
+};
+
+//Size column of a CSV line (the fifth), read only for trades.
+double record_size(const std::string& line) {
+	size_t start = 0;
+	for (int column = 0; column < 4 && start != std::string::npos; column++) {
+		start = line.find(',', start);
+		start = start == std::string::npos ? start : start + 1;
+	}
+	return start == std::string::npos ? 0 : std::strtod(line.c_str() + start, nullptr);
+}
+
+/*
+ * Bins one session CSV into num_bins rows of out (row-major, layout.num_columns() floats per row) starting at
+ * start_time. Events arrive in time order, so counts for the current bin are gathered in a small row buffer and added
+ * to out in one contiguous, vectorisable pass whenever the bin changes, rather than scattered into the big array.
+ */
+void bin_session(const std::string& filename, const BinningLayout& layout, REAL start_time, size_t num_bins, float* out) {
+	std::ifstream file(filename);
+	std::string line;
+	if (!std::getline(file, line)) {
+		std::cerr << "could not read " << filename << std::endl;
+		return;
+	}
+	int columns = layout.num_columns();
+	std::vector<float> row(columns, 0.0f);
+	long current_bin = -1;
+	size_t row_events = 0, dropped = 0;
+	auto flush = [&]() {
+		if (current_bin >= 0 && current_bin < (long)num_bins) {
+			float* destination = out + current_bin * columns;
+			for (int c = 0; c < columns; c++) {
+				destination[c] += row[c];
+			}
+		} else {
+			dropped += row_events;
+		}
+		std::fill(row.begin(), row.end(), 0.0f);
+		row_events = 0;
+	};
+
+	std::string_view instrument;
+	std::string last_instrument;
+	int instrument_index = -1;
+	REAL time;
+	int event_type;
+	while (std::getline(file, line)) {
+		if (!parse_record_key(line, instrument, time, event_type)) {
+			continue;
+		}
+		if (last_instrument.empty() || instrument != last_instrument) {
+			last_instrument = instrument;
+			instrument_index = layout.instrument_index(instrument);
+		}
+		if (instrument_index < 0) {
+			continue;
+		}
+		long bin = std::floor((time - start_time) / layout.bin_width);
+		if (bin != current_bin) {
+			flush();
+			current_bin = bin;
+		}
+		row[layout.count_column(instrument_index, event_type)] += 1;
+		row_events++;
+		if (event_action(event_type) == TRADE) {
+			row[layout.volume_column(instrument_index)] += (event_side(event_type) == BID ? 1 : -1) * record_size(line);
+		}
+	}
+	flush();
+	if (dropped > 0) {
+		std::cerr << dropped << " events of " << filename << " fall outside its " << num_bins << " bins" << std::endl;
+	}
+}
+
+/*
+ * Writes a float32 matrix as a .npy file through a shared memory map, so np.load(filename, mmap_mode='r') reads
+ * it in place without copying. The header is padded to 64 bytes as numpy expects.
+ */
+class NpyMatrixFile {
+	public:
+		NpyMatrixFile(const std::string& filename, size_t rows, size_t columns) : rows(rows), columns(columns) {
+			std::string header = "{'descr': '<f4', 'fortran_order': False, 'shape': (" + std::to_string(rows) + ", " + std::to_string(columns) + "), }";
+			size_t unpadded = 10 + header.size() + 1;
+			header += std::string((64 - unpadded % 64) % 64, ' ') + "\n";
+			header_size = 10 + header.size();
+			size = header_size + rows * columns * sizeof(float);
+
+			descriptor = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+			if (descriptor < 0 || ftruncate(descriptor, size) != 0) {
+				std::cerr << "could not create " << filename << std::endl;
+				return;
+			}
+			void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+			if (address == MAP_FAILED) {
+				std::cerr << "could not map " << filename << std::endl;
+				return;
+			}
+			data = static_cast<char*>(address);
+			uint16_t header_length = header.size();
+			std::memcpy(data, "\x93NUMPY\x01\x00", 8);
+			std::memcpy(data + 8, &header_length, sizeof(header_length));
+			std::memcpy(data + 10, header.data(), header.size());
+		}
+
+		NpyMatrixFile(const NpyMatrixFile&) = delete;
+		NpyMatrixFile& operator=(const NpyMatrixFile&) = delete;
+
+		~NpyMatrixFile() {
+			if (data) {
+				msync(data, size, MS_SYNC);
+				munmap(data, size);
+			}
+			if (descriptor >= 0) {
+				::close(descriptor);
+			}
+		}
+
+		//First float of a row; the file is created zeroed.
+		float* row(size_t r) {
+			return data ? reinterpret_cast<float*>(data + header_size) + r * columns : nullptr;
+		}
+
+		size_t rows, columns;
+
+	private:
+		int descriptor = -1;
+		char* data = nullptr;
+		size_t header_size = 0, size = 0;
+};
+
+//Read-only map of a row-major float32 .npy matrix such as NpyMatrixFile writes; pages are only read when touched.
+class NpyMatrixView {
+	public:
+		NpyMatrixView(const std::string& filename) {
+			descriptor = ::open(filename.c_str(), O_RDONLY);
+			char prefix[10];
+			if (descriptor < 0 || ::read(descriptor, prefix, sizeof(prefix)) != sizeof(prefix) || std::memcmp(prefix, "\x93NUMPY", 6) != 0) {
+				std::cerr << filename << " is not a .npy file" << std::endl;
+				return;
+			}
+			uint16_t header_length;
+			std::memcpy(&header_length, prefix + 8, sizeof(header_length));
+			std::string header(header_length, ' ');
+			if (::read(descriptor, header.data(), header_length) != header_length || header.find("'<f4'") == std::string::npos || header.find("'fortran_order': False") == std::string::npos) {
+				std::cerr << filename << " is not a row-major float32 matrix" << std::endl;
+				return;
+			}
+			size_t shape = header.find("'shape': (");
+			if (shape == std::string::npos || std::sscanf(header.c_str() + shape + 10, "%zu, %zu", &rows, &columns) != 2) {
+				std::cerr << filename << " has no two-dimensional shape" << std::endl;
+				return;
+			}
+			header_size = 10 + header_length;
+			size = header_size + rows * columns * sizeof(float);
+			void* address = mmap(nullptr, size, PROT_READ, MAP_SHARED, descriptor, 0);
+			if (address == MAP_FAILED) {
+				std::cerr << "could not map " << filename << std::endl;
+				rows = columns = 0;
+				return;
+			}
+			data = static_cast<const char*>(address);
+		}
+
+		NpyMatrixView(const NpyMatrixView&) = delete;
+		NpyMatrixView& operator=(const NpyMatrixView&) = delete;
+
+		~NpyMatrixView() {
+			if (data) {
+				munmap(const_cast<char*>(data), size);
+			}
+			if (descriptor >= 0) {
+				::close(descriptor);
+			}
+		}
+
+		//Rows [first, first + count) as an Eigen view, without copying.
+		Eigen::Map<const Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> block(size_t first, size_t count) const {
+			return {reinterpret_cast<const float*>(data + header_size) + first * columns, (Eigen::Index)count, (Eigen::Index)columns};
+		}
+
+		size_t rows = 0, columns = 0;
+
+	private:
+		int descriptor = -1;
+		const char* data = nullptr;
+		size_t header_size = 0, size = 0;
+};
+
+/*
+ * Bins many sessions into one .npy matrix, one block of rows per session stacked in schedule order, on num_threads
+ * threads. The catalog gives every session's bounds up front, so each session's block is known before binning and
+ * threads write disjoint rows of the mapped file with nothing to merge. The column names and each session's first
+ * row, start time and number of bins are written to filename + ".meta" (lines "columns,..." and
+ * "session,path,first_row,start_time,num_bins").
+ */
+void run_event_binning(const std::vector<std::string>& paths, const BinningLayout& layout, const std::string& filename, DatasetCatalog& catalog, int num_threads=std::thread::hardware_concurrency()) {
+	std::vector<CatalogEntry> sessions = catalog.schedule(paths);
+	std::vector<size_t> first_row(sessions.size() + 1, 0);
+	for (size_t s = 0; s < sessions.size(); s++) {
+		//One more than the bins the span divides into, for an event exactly at session_end (a last event on the hour).
+		size_t bins = sessions[s].num_records == 0 ? 0 : (size_t)std::floor((sessions[s].session_end() - sessions[s].session_start()) / layout.bin_width) + 1;
+		first_row[s + 1] = first_row[s] + bins;
+	}
+
+	std::ofstream meta(filename + ".meta");
+	meta << "columns";
+	for (const std::string& name : layout.column_names()) {
+		meta << "," << name;
+	}
+	meta << "\n";
+	for (size_t s = 0; s < sessions.size(); s++) {
+		meta << "session," << sessions[s].path << "," << first_row[s] << "," << (double)sessions[s].session_start() << "," << first_row[s + 1] - first_row[s] << "\n";
+	}
+
+	NpyMatrixFile matrix(filename, first_row.back(), layout.num_columns());
+	std::atomic<size_t> next_session(0);
+	auto worker = [&]() {
+		for (size_t s = next_session++; s < sessions.size(); s = next_session++) {
+			if (first_row[s + 1] > first_row[s] && matrix.row(0)) {
+				bin_session(sessions[s].path, layout, sessions[s].session_start(), first_row[s + 1] - first_row[s], matrix.row(first_row[s]));
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < std::max(num_threads, 1); t++) {
+		threads.emplace_back(worker);
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+}
+
+//One session's block of rows in a binned matrix, as listed in its .meta file.
+struct BinnedSession {
+	std::string path;
+	size_t first_row;
+	REAL start_time;
+	size_t num_bins;
+};
+
+//Reads the session lines of the .meta file run_event_binning writes next to filename.
+std::vector<BinnedSession> read_binning_sessions(const std::string& filename) {
+	std::vector<BinnedSession> sessions;
+	std::ifstream meta(filename + ".meta");
+	if (!meta) {
+		std::cerr << "could not read " << filename << ".meta" << std::endl;
+		return sessions;
+	}
+	std::string line;
+	while (std::getline(meta, line)) {
+		if (line.rfind("session,", 0) != 0) {
+			continue;
+		}
+		//The path may hold commas, so the numeric fields are taken from the end.
+		size_t bins_comma = line.rfind(',');
+		size_t start_comma = bins_comma > 8 ? line.rfind(',', bins_comma - 1) : std::string::npos;
+		size_t row_comma = start_comma != std::string::npos && start_comma > 8 ? line.rfind(',', start_comma - 1) : std::string::npos;
+		if (row_comma == std::string::npos || row_comma <= 7) {
+			continue;
+		}
+		sessions.push_back({line.substr(8, row_comma - 8), std::stoull(line.substr(row_comma + 1)), std::stold(line.substr(start_comma + 1)), std::stoull(line.substr(bins_comma + 1))});
+	}
+	return sessions;
+}
+
+#endif //BINNING_H
@@ -0,0 +1,268 @@
+#ifndef BOOK_H
+#define BOOK_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+
+//Non-empty levels of an L2Book as (tick, size) pairs per side, enough to rebuild it exactly.
+struct BookSnapshot {
+	std::vector<std::pair<long, double>> levels[2];
+	long last_touch[2];
+};
+
+/*
+ * Aggregated (L2) book stored as two flat arrays of sizes indexed by tick, over a window of num_levels ticks.
+ * Every operation is an array index plus, when a touch level empties, a scan to the next non-empty level, so there is
+ * no allocation or tree rebalancing per event. The window is recentred on the touch when it drifts near an edge;
+ * levels that fall outside it are dropped, so num_levels should comfortably cover the depth that matters.
+ */
+class L2Book {
+	public:
+		L2Book(REAL tick_size, int num_levels=4096) : tick_size(tick_size), num_levels(num_levels) {
+			levels[BID].assign(num_levels, 0.0);
+			levels[ASK].assign(num_levels, 0.0);
+			clear();
+		}
+
+		void clear() {
+			std::fill(levels[BID].begin(), levels[BID].end(), 0.0);
+			std::fill(levels[ASK].begin(), levels[ASK].end(), 0.0);
+			best_index[BID] = -1;
+			best_index[ASK] = num_levels;
+			base_tick = 0;
+			centred = false;
+		}
+
+		long to_tick(double price) const {
+			return std::lround(price / (double)tick_size);
+		}
+
+		double to_price(long tick) const {
+			return tick * (double)tick_size;
+		}
+
+		bool empty(BookSide side) const {
+			return side == BID ? best_index[BID] < 0 : best_index[ASK] >= num_levels;
+		}
+
+		long best(BookSide side) const {
+			return base_tick + best_index[side];
+		}
+
+		//Best price on a side, or where it would be if that side is empty: one tick through the other side, else the last touch.
+		long touch(BookSide side) const {
+			if (!empty(side)) {
+				return best(side);
+			}
+			BookSide other = side == BID ? ASK : BID;
+			if (!empty(other)) {
+				return best(other) + (side == BID ? -1 : 1);
+			}
+			return last_touch[side];
+		}
+
+		double size_at(BookSide side, long tick) const {
+			long index = tick - base_tick;
+			return index >= 0 && index < num_levels ? levels[side][index] : 0.0;
+		}
+
+		//Size of the level-th non-empty level from the touch (0 is the best), or zero if there are fewer levels.
+		double depth(BookSide side, int level) const {
+			int step = side == BID ? -1 : 1;
+			for (int index = best_index[side]; index >= 0 && index < num_levels; index += step) {
+				if (levels[side][index] > 0 && level-- == 0) {
+					return levels[side][index];
+				}
+			}
+			return 0.0;
+		}
+
+		void add(BookSide side, long tick, double size) {
+			if (!centred) {
+				recentre(tick);
+			}
+			long index = tick - base_tick;
+			if (index < margin() || index >= num_levels - margin()) {
+				//Only recentre for orders at or through the touch; deep orders outside the window are dropped.
+				bool at_touch = empty(side) || (side == BID ? tick >= best(BID) : tick <= best(ASK));
+				if (!at_touch && (index < 0 || index >= num_levels)) {
+					return;
+				}
+				if (at_touch) {
+					recentre(tick);
+					index = tick - base_tick;
+				}
+			}
+			levels[side][index] += size;
+			if (side == BID ? index > best_index[BID] : index < best_index[ASK]) {
+				best_index[side] = index;
+			}
+			last_touch[side] = best(side);
+		}
+
+		//Removes up to size from one level and returns how much was there to remove.
+		double remove(BookSide side, long tick, double size) {
+			long index = tick - base_tick;
+			if (index < 0 || index >= num_levels) {
+				return 0.0;
+			}
+			double removed = std::min(size, levels[side][index]);
+			levels[side][index] -= removed;
+			if (levels[side][index] <= 0) {
+				levels[side][index] = 0;
+				if (index == best_index[side]) {
+					advance_best(side);
+				}
+			}
+			return removed;
+		}
+
+		//Takes up to size from the resting side, walking through levels from the touch; returns the size filled.
+		double take(BookSide resting_side, double size) {
+			double filled = 0;
+			while (filled < size && !empty(resting_side)) {
+				filled += remove(resting_side, best(resting_side), size - filled);
+			}
+			return filled;
+		}
+
+		//Makes tick the best level on a side with the given size, clearing anything better; a NaN price empties the side.
+		void set_touch(BookSide side, double price, double size) {
+			if (std::isnan(price) || std::isnan(size) || size <= 0) {
+				while (!empty(side)) {
+					remove(side, best(side), INFINITY);
+				}
+				return;
+			}
+			long tick = to_tick(price);
+			if (!empty(side)) {
+				while (side == BID ? best(BID) > tick : best(ASK) < tick) {
+					remove(side, best(side), INFINITY);
+					if (empty(side)) {
+						break;
+					}
+				}
+			}
+			remove(side, tick, INFINITY);
+			add(side, tick, size);
+		}
+
+		/*
+		 * Applies a CSV event: adds and cancels change their level by the order's size, trades and fills change nothing
+		 * (the feed follows them with cancels). The CSV has no order ids, so a modify's old level is unknown and only
+		 * the touch is kept exact, by reconciling both sides with the event's BBO marks; depth is approximate.
+		 */
+		void apply(const Event& event) {
+			if (event.marks.size() > ORDER_PRICE && !std::isnan(event.marks[ORDER_PRICE])) {
+				BookSide side = event_side(event.event_type);
+				long tick = to_tick(event.marks[ORDER_PRICE]);
+				if (event_action(event.event_type) == ADD) {
+					add(side, tick, event.marks[ORDER_SIZE]);
+				} else if (event_action(event.event_type) == CANCEL) {
+					remove(side, tick, event.marks[ORDER_SIZE]);
+				}
+			}
+			if (event.marks.size() > ASK_PRICE) {
+				set_touch(BID, event.marks[BID_PRICE], event.marks[BID_SIZE]);
+				set_touch(ASK, event.marks[ASK_PRICE], event.marks[ASK_SIZE]);
+			}
+		}
+
+		BookSnapshot snapshot() const {
+			BookSnapshot snapshot;
+			for (int side = BID; side <= ASK; side++) {
+				for (int index = 0; index < num_levels; index++) {
+					if (levels[side][index] > 0) {
+						snapshot.levels[side].push_back({base_tick + index, levels[side][index]});
+					}
+				}
+				snapshot.last_touch[side] = last_touch[side];
+			}
+			return snapshot;
+		}
+
+		void restore(const BookSnapshot& snapshot) {
+			clear();
+			long bid = snapshot.levels[BID].empty() ? snapshot.last_touch[BID] : snapshot.levels[BID].back().first;
+			long ask = snapshot.levels[ASK].empty() ? snapshot.last_touch[ASK] : snapshot.levels[ASK].front().first;
+			recentre((bid + ask) / 2);
+			for (int side = BID; side <= ASK; side++) {
+				for (const auto& [tick, size] : snapshot.levels[side]) {
+					if (tick - base_tick >= 0 && tick - base_tick < num_levels) {
+						levels[side][tick - base_tick] = size;
+					}
+				}
+				last_touch[side] = snapshot.last_touch[side];
+			}
+			best_index[BID] = num_levels - 1;
+			advance_best(BID);
+			best_index[ASK] = 0;
+			advance_best(ASK);
+		}
+
+		//BBO in the BookMark layout, with NaN for an empty side as in the CSV.
+		void write_marks(Eigen::VectorXd& marks) const {
+			marks[BID_SIZE] = empty(BID) ? NAN : levels[BID][best_index[BID]];
+			marks[BID_PRICE] = empty(BID) ? NAN : to_price(best(BID));
+			marks[ASK_SIZE] = empty(ASK) ? NAN : levels[ASK][best_index[ASK]];
+			marks[ASK_PRICE] = empty(ASK) ? NAN : to_price(best(ASK));
+		}
+
+		REAL tick_size;
+		int num_levels;
+
+	private:
+		int margin() const {
+			return num_levels / 8;
+		}
+
+		void advance_best(BookSide side) {
+			int step = side == BID ? -1 : 1;
+			int index = best_index[side];
+			while (index >= 0 && index < num_levels && levels[side][index] <= 0) {
+				index += step;
+			}
+			best_index[side] = index;
+			if (!empty(side)) {
+				last_touch[side] = best(side);
+			}
+		}
+
+		//Moves the window so that tick sits in the middle, keeping every level that still fits.
+		void recentre(long tick) {
+			long new_base = tick - num_levels / 2;
+			long shift = new_base - base_tick;
+			for (int side = BID; side <= ASK; side++) {
+				std::vector<double>& sizes = levels[side];
+				if (!centred || std::abs(shift) >= num_levels) {
+					std::fill(sizes.begin(), sizes.end(), 0.0);
+				} else if (shift > 0) {
+					std::move(sizes.begin() + shift, sizes.end(), sizes.begin());
+					std::fill(sizes.end() - shift, sizes.end(), 0.0);
+				} else if (shift < 0) {
+					std::move_backward(sizes.begin(), sizes.end() + shift, sizes.end());
+					std::fill(sizes.begin(), sizes.begin() - shift, 0.0);
+				}
+			}
+			base_tick = new_base;
+			centred = true;
+			//Re-find both touches from the far edge, since either may have been shifted out.
+			best_index[BID] = num_levels - 1;
+			advance_best(BID);
+			best_index[ASK] = 0;
+			advance_best(ASK);
+		}
+
+		std::vector<double> levels[2];
+		long base_tick;
+		int best_index[2];
+		long last_touch[2] = {0, 0};
+		bool centred;
+};
+
+#endif //BOOK_H
@@ -0,0 +1,171 @@
+#ifndef BOOTSTRAP_H
+#define BOOTSTRAP_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+#include "Parse.h"
+#include "Kernel.h"
+#include "Optimizer.h"
+
+//A stretch of events over [start_time, end_time). Blocks are only ever resampled from within their own group.
+struct EventBlock {
+	REAL start_time, end_time;
+	std::vector<Event> events;
+	int group;
+};
+
+//Reads a whole session into memory, with its bounds rounded out to the hour as in inference.cpp.
+EventBlock read_session(const std::string& filename, int group=0) {
+	EventBlock session{0, 0, {}, group};
+	Realisation realisation(filename);
+	for (const auto event : realisation) {
+		session.events.push_back(*event);
+	}
+	if (!session.events.empty()) {
+		session.start_time = std::floor(session.events.front().time / 3600) * 3600;
+		session.end_time = std::ceil(session.events.back().time / 3600) * 3600;
+	}
+	return session;
+}
+
+//Cuts a session into consecutive blocks of block_length seconds, all in the session's group, for a block bootstrap within the day.
+std::vector<EventBlock> split_into_blocks(const EventBlock& session, REAL block_length) {
+	std::vector<EventBlock> blocks;
+	auto event = session.events.begin();
+	for (REAL start = session.start_time; start < session.end_time; start += block_length) {
+		EventBlock block{start, std::min(start + block_length, session.end_time), {}, session.group};
+		for (; event != session.events.end() && event->time < block.end_time; event++) {
+			block.events.push_back(*event);
+		}
+		blocks.push_back(std::move(block));
+	}
+	return blocks;
+}
+
+struct BootstrapResult {
+	Eigen::VectorXd estimate;
+	//num_params x num_replicates.
+	Eigen::MatrixXd replicates;
+	int num_converged;
+
+	//Per-parameter q-quantile of the replicates, interpolating linearly between order statistics.
+	Eigen::VectorXd quantile(REAL q) const {
+		Eigen::VectorXd quantiles(replicates.rows());
+		for (int i = 0; i < replicates.rows(); i++) {
+			std::vector<double> values(replicates.cols());
+			Eigen::VectorXd::Map(values.data(), values.size()) = replicates.row(i);
+			std::sort(values.begin(), values.end());
+			REAL position = q * (values.size() - 1);
+			int below = std::floor(position);
+			int above = std::min(below + 1, (int)values.size() - 1);
+			quantiles[i] = values[below] + (position - below) * (values[above] - values[below]);
+		}
+		return quantiles;
+	}
+
+	std::pair<Eigen::VectorXd,Eigen::VectorXd> percentile_interval(REAL level=0.95) const {
+		return {quantile((1 - level) / 2), quantile((1 + level) / 2)};
+	}
+
+	void print(std::ostream& os, REAL level=0.95) const {
+		auto [lower, upper] = percentile_interval(level);
+		os << num_converged << "/" << replicates.cols() << " replicates converged, " << level * 100 << "% percentile intervals:" << std::endl;
+		for (int i = 0; i < estimate.size(); i++) {
+			os << i << ": " << estimate[i] << " [" << lower[i] << ", " << upper[i] << "]" << std::endl;
+		}
+	}
+};
+
+/*
+ * Lays the blocks end to end from the first block's start, each replaced by a block drawn uniformly from its own group.
+ * With one group of whole sessions this is the session bootstrap across days; with one group per session cut up by
+ * split_into_blocks it is a block bootstrap within each day. Laying blocks end to end keeps the total exposure equal to
+ * the original, though excitation carries over block boundaries and time of day is only kept by whole-day blocks.
+ */
+REAL draw_replicate(const std::vector<EventBlock>& blocks, const std::vector<std::vector<int>>& groups, std::mt19937_64& rng, std::vector<Event>& events) {
+	events.clear();
+	REAL cursor = blocks.front().start_time;
+	for (const EventBlock& position : blocks) {
+		const std::vector<int>& candidates = groups[position.group];
+		const EventBlock& drawn = blocks[candidates[std::uniform_int_distribution<size_t>(0, candidates.size() - 1)(rng)]];
+		REAL offset = cursor - drawn.start_time;
+		for (const Event& event : drawn.events) {
+			events.push_back(event);
+			events.back().time += offset;
+		}
+		cursor += drawn.end_time - drawn.start_time;
+	}
+	return cursor;
+}
+
+/*
+ * Refits num_replicates bootstrap resamples of blocks on num_threads threads and collects the fitted parameters.
+ * make_kernel() must return a fresh std::unique_ptr<Kernel>; all kernels are built on the calling thread before any
+ * worker starts, since kernel constructors draw their initial parameters from std::rand. Each replicate is warm-started
+ * from estimate (the point estimate of the full fit), so options.max_passes can usually be kept small. A replicate's events are
+ * materialised once and every optimiser pass sweeps them in memory, and kernels with parameter-free statistics
+ * (Poisson, seasonal background) are only swept once per replicate. Replicate r uses seed + r, so results do not
+ * depend on the number of threads.
+ */
+template <class KernelFactory>
+BootstrapResult run_bootstrap(const std::vector<EventBlock>& blocks, KernelFactory make_kernel, Eigen::VectorXd estimate, int num_replicates, OptimizerOptions options=OptimizerOptions(), int num_threads=std::thread::hardware_concurrency(), unsigned long seed=0) {
+	std::vector<std::vector<int>> groups;
+	for (size_t b = 0; b < blocks.size(); b++) {
+		if (blocks[b].group >= (int)groups.size()) {
+			groups.resize(blocks[b].group + 1);
+		}
+		groups[blocks[b].group].push_back(b);
+	}
+
+	BootstrapResult result{estimate, Eigen::MatrixXd(estimate.size(), num_replicates), 0};
+	std::vector<std::unique_ptr<Kernel>> kernels;
+	for (int r = 0; r < num_replicates; r++) {
+		kernels.push_back(make_kernel());
+	}
+	std::atomic<int> next_replicate(0), num_converged(0);
+
+	auto worker = [&]() {
+		std::vector<Event> events;
+		for (int r = next_replicate++; r < num_replicates; r = next_replicate++) {
+			std::mt19937_64 rng(seed + r);
+			REAL end_time = draw_replicate(blocks, groups, rng, events);
+
+			std::unique_ptr<Kernel> kernel = std::move(kernels[r]);
+			kernel->start_time = blocks.front().start_time;
+			kernel->end_time = end_time;
+			kernel->set_params(estimate);
+			auto pass = [&](Kernel& kernel) {
+				for (const Event& event : events) {
+					kernel.update(event);
+				}
+			};
+			OptimizerResult fit = Optimizer(*kernel, pass, options).maximise();
+			//Each replicate owns its column, so no lock is needed.
+			result.replicates.col(r) = fit.params;
+			num_converged += fit.converged;
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < std::max(num_threads, 1); t++) {
+		threads.emplace_back(worker);
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	result.num_converged = num_converged;
+	return result;
+}
+
+#endif //BOOTSTRAP_H
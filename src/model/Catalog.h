@@ -0,0 +1,257 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <algorithm>
+#include <filesystem>
+#include <cstdint>
+#include <cmath>
+
+#include "Types.h"
+#include "Parse.h"
+
+//What one session CSV holds, recorded the first time it is read.
+struct CatalogEntry {
+	std::string path;
+	uint64_t file_size;
+	int64_t modified;
+	//The bounds databento_parse.py writes on the first line (metadata start and end, in nanoseconds).
+	REAL metadata_start, metadata_end;
+	//Times of the first and last parsed event, in the CSV's time column.
+	REAL first_time, last_time;
+	uint64_t num_records;
+	std::vector<uint64_t> type_counts;
+	std::vector<std::string> instruments;
+	//Byte offsets of the first and last parsed event, for EventIterator(filename, offset).
+	int64_t first_offset, last_offset;
+
+	//The session rounded out to whole hours, as the kernels' start_time and end_time (see read_session).
+	REAL session_start() const {
+		return std::floor(first_time / 3600) * 3600;
+	}
+
+	REAL session_end() const {
+		return std::ceil(last_time / 3600) * 3600;
+	}
+};
+
+/*
+ * Persistent catalog of session CSVs: each file is scanned once (one line split per record, without building events)
+ * and its entry is kept in a small binary file, so bounds, counts and instruments are answered without reading the
+ * data again. An entry is rescanned when its file's size or modification time changes.
+ * Layout: the magic bytes, u32 count, then per entry u32 path length, path bytes, u64 file_size, i64 modified,
+ *	f64 metadata_start, metadata_end, first_time, last_time, u64 num_records, u32 n, u64[n] type_counts,
+ *	u32 m, m x (u32 length, bytes) instruments, i64 first_offset, i64 last_offset
+ */
+class DatasetCatalog {
+	public:
+		DatasetCatalog(std::string filename) : filename(filename) {
+			std::ifstream file(filename, std::ios::binary);
+			char header[sizeof(magic)];
+			uint32_t count;
+			if (!file || !file.read(header, sizeof(magic)) || std::string(header, sizeof(magic)) != std::string(magic, sizeof(magic)) || !read(file, count)) {
+				return;
+			}
+			for (uint32_t e = 0; e < count; e++) {
+				std::optional<CatalogEntry> entry = read_entry(file);
+				if (!entry) {
+					break;
+				}
+				entries[entry->path] = *entry;
+			}
+		}
+
+		//The file's entry, scanning it (and saving the catalog) if it is new or has changed.
+		const CatalogEntry& entry(const std::string& path) {
+			std::string key = std::filesystem::absolute(path).lexically_normal().string();
+			if (!std::filesystem::exists(path)) {
+				std::cerr << "could not open " << path << std::endl;
+				CatalogEntry& missing = entries[key] = CatalogEntry{key, 0, 0, NAN, NAN, NAN, NAN, 0, std::vector<uint64_t>(num_order_event_types, 0), {}, -1, -1};
+				return missing;
+			}
+			auto found = entries.find(key);
+			if (found != entries.end() && found->second.file_size == std::filesystem::file_size(path) && found->second.modified == modified_time(path)) {
+				return found->second;
+			}
+			CatalogEntry& scanned = entries[key] = scan(path);
+			scanned.path = key;
+			save();
+			return scanned;
+		}
+
+		//Entries for every path given, ordered by first event time, for scheduling a run over several sessions.
+		std::vector<CatalogEntry> schedule(const std::vector<std::string>& paths) {
+			std::vector<CatalogEntry> result;
+			for (const std::string& path : paths) {
+				result.push_back(entry(path));
+			}
+			std::sort(result.begin(), result.end(), [](const CatalogEntry& a, const CatalogEntry& b) {
+				return a.first_time < b.first_time;
+			});
+			return result;
+		}
+
+		//Catalogued files with any event in [start, end).
+		std::vector<CatalogEntry> overlapping(REAL start, REAL end) const {
+			std::vector<CatalogEntry> result;
+			for (const auto& [path, entry] : entries) {
+				if (entry.num_records > 0 && entry.first_time < end && entry.last_time >= start) {
+					result.push_back(entry);
+				}
+			}
+			std::sort(result.begin(), result.end(), [](const CatalogEntry& a, const CatalogEntry& b) {
+				return a.first_time < b.first_time;
+			});
+			return result;
+		}
+
+	private:
+		static constexpr char magic[8] = {'O', 'B', 'S', 'C', 'A', 'T', 'L', '1'};
+
+		static int64_t modified_time(const std::string& path) {
+			return std::filesystem::last_write_time(path).time_since_epoch().count();
+		}
+
+		//Counts the same records as EventIterator, via parse_record_key.
+		static CatalogEntry scan(const std::string& path) {
+			CatalogEntry entry{path, std::filesystem::file_size(path), modified_time(path), NAN, NAN, NAN, NAN, 0, std::vector<uint64_t>(num_order_event_types, 0), {}, -1, -1};
+			std::ifstream file(path);
+			std::string line;
+			if (!std::getline(file, line)) {
+				return entry;
+			}
+			size_t comma = line.find(',');
+			if (comma != std::string::npos) {
+				entry.metadata_start = std::stold(line.substr(0, comma));
+				entry.metadata_end = std::stold(line.substr(comma + 1));
+			}
+			std::set<std::string> instruments;
+			std::string last_instrument;
+			int64_t offset = line.size() + 1;
+			while (std::getline(file, line)) {
+				int64_t line_offset = offset;
+				offset += line.size() + 1;
+				std::string_view instrument;
+				REAL time;
+				int event_type;
+				if (!parse_record_key(line, instrument, time, event_type)) {
+					continue;
+				}
+				if (entry.num_records == 0) {
+					entry.first_time = time;
+					entry.first_offset = line_offset;
+				}
+				entry.last_time = time;
+				entry.last_offset = line_offset;
+				entry.num_records++;
+				entry.type_counts[event_type]++;
+				//Consecutive lines are nearly always the same instrument, so only look it up when it changes.
+				if (instruments.empty() || instrument != last_instrument) {
+					last_instrument = instrument;
+					instruments.insert(last_instrument);
+				}
+			}
+			entry.instruments.assign(instruments.begin(), instruments.end());
+			return entry;
+		}
+
+		template <class T>
+		static void write(std::ofstream& file, T value) {
+			file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+		}
+
+		static void write_string(std::ofstream& file, const std::string& value) {
+			write<uint32_t>(file, value.size());
+			file.write(value.data(), value.size());
+		}
+
+		template <class T>
+		static bool read(std::ifstream& file, T& value) {
+			return (bool)file.read(reinterpret_cast<char*>(&value), sizeof(value));
+		}
+
+		static bool read_string(std::ifstream& file, std::string& value) {
+			uint32_t length;
+			if (!read(file, length)) {
+				return false;
+			}
+			value.resize(length);
+			return (bool)file.read(value.data(), length);
+		}
+
+		static bool read_real(std::ifstream& file, REAL& value) {
+			double raw;
+			bool ok = read(file, raw);
+			value = raw;
+			return ok;
+		}
+
+		//Rewrites the whole catalog, which is small, to a temporary file renamed over the old one.
+		void save() const {
+			std::string temporary = filename + ".tmp";
+			{
+				std::ofstream file(temporary, std::ios::binary);
+				file.write(magic, sizeof(magic));
+				write<uint32_t>(file, entries.size());
+				for (const auto& [path, entry] : entries) {
+					write_string(file, entry.path);
+					write<uint64_t>(file, entry.file_size);
+					write<int64_t>(file, entry.modified);
+					write<double>(file, entry.metadata_start);
+					write<double>(file, entry.metadata_end);
+					write<double>(file, entry.first_time);
+					write<double>(file, entry.last_time);
+					write<uint64_t>(file, entry.num_records);
+					write<uint32_t>(file, entry.type_counts.size());
+					for (uint64_t count : entry.type_counts) {
+						write<uint64_t>(file, count);
+					}
+					write<uint32_t>(file, entry.instruments.size());
+					for (const std::string& instrument : entry.instruments) {
+						write_string(file, instrument);
+					}
+					write<int64_t>(file, entry.first_offset);
+					write<int64_t>(file, entry.last_offset);
+				}
+			}
+			std::filesystem::rename(temporary, filename);
+		}
+
+		static std::optional<CatalogEntry> read_entry(std::ifstream& file) {
+			CatalogEntry entry;
+			uint32_t num_types, num_instruments;
+			if (!read_string(file, entry.path) || !read(file, entry.file_size) || !read(file, entry.modified) || !read_real(file, entry.metadata_start) || !read_real(file, entry.metadata_end) || !read_real(file, entry.first_time) || !read_real(file, entry.last_time) || !read(file, entry.num_records) || !read(file, num_types)) {
+				return std::nullopt;
+			}
+			entry.type_counts.resize(num_types);
+			for (uint64_t& count : entry.type_counts) {
+				if (!read(file, count)) {
+					return std::nullopt;
+				}
+			}
+			if (!read(file, num_instruments)) {
+				return std::nullopt;
+			}
+			entry.instruments.resize(num_instruments);
+			for (std::string& instrument : entry.instruments) {
+				if (!read_string(file, instrument)) {
+					return std::nullopt;
+				}
+			}
+			if (!read(file, entry.first_offset) || !read(file, entry.last_offset)) {
+				return std::nullopt;
+			}
+			return entry;
+		}
+
+		std::string filename;
+		std::map<std::string, CatalogEntry> entries;
+};
+
+#endif //CATALOG_H
@@ -0,0 +1,222 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <iostream>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+#include "Parse.h"
+#include "Kernel.h"
+
+/*
+ * P(K > lambda) for the Kolmogorov distribution. The alternating series 2 sum (-1)^(k-1) exp(-2 k^2 lambda^2)
+ * converges fast for large lambda but cancels to nothing as lambda goes to 0, so below 1.18 the equivalent
+ * theta-function series 1 - sqrt(2 pi) / lambda sum exp(-(2k-1)^2 pi^2 / (8 lambda^2)) is used instead (as in
+ * Numerical Recipes' Kolmogorov-Smirnov distribution). Both stop once a term no longer changes the sum.
+ */
+double kolmogorov_survival(double lambda) {
+	if (!(lambda > 0)) {
+		return 1.0;
+	}
+	if (lambda < 1.18) {
+		double cdf = 0;
+		for (int k = 1; k <= 100; k++) {
+			double term = std::exp(-(2 * k - 1) * (2 * k - 1) * M_PI * M_PI / (8 * lambda * lambda));
+			cdf += term;
+			if (term <= 1e-16 * cdf) {
+				break;
+			}
+		}
+		return std::clamp(1 - std::sqrt(2 * M_PI) / lambda * cdf, 0.0, 1.0);
+	}
+	double p = 0;
+	for (int k = 1; k <= 100; k++) {
+		double term = 2 * (k % 2 ? 1 : -1) * std::exp(-2.0 * k * k * lambda * lambda);
+		p += term;
+		if (std::abs(term) <= 1e-16 * std::abs(p)) {
+			break;
+		}
+	}
+	return std::clamp(p, 0.0, 1.0);
+}
+
+/*
+ * Time-rescaling goodness-of-fit statistics.
+ * If the kernel is correct, the compensator increments between consecutive events of the same type are iid Exp(1),
+ * so u = 1 - exp(-residual) is Uniform(0,1). Residuals are never stored: u goes into a fixed-width histogram
+ * (giving the KS statistic to within one bin width and the QQ curve), and autocorrelations are accumulated from a
+ * ring buffer of the last max_lag residuals. Memory is O(num_bins + max_lag) per event type regardless of data size.
+ */
+class TimeRescalingDiagnostics {
+	public:
+		TimeRescalingDiagnostics(int num_event_types, int num_bins=1000, int max_lag=10) : num_event_types(num_event_types), num_bins(num_bins), max_lag(max_lag) {
+			histogram = Eigen::MatrixXd::Constant(num_bins, num_event_types, 0.0);
+			counts = Eigen::VectorXd::Constant(num_event_types, 0.0);
+			sums = Eigen::VectorXd::Constant(num_event_types, 0.0);
+			sums_of_squares = Eigen::VectorXd::Constant(num_event_types, 0.0);
+			lag_products = Eigen::MatrixXd::Constant(max_lag, num_event_types, 0.0);
+			lag_counts = Eigen::MatrixXd::Constant(max_lag, num_event_types, 0.0);
+			start_session();
+		}
+
+		//Residuals are only correlated within a session, so lags never span two sessions.
+		void start_session() {
+			recent = Eigen::MatrixXd::Constant(max_lag, num_event_types, 0.0);
+			num_recent = std::vector<int>(num_event_types, 0);
+		}
+
+		void observe(int event_type, REAL residual) {
+			double x = residual;
+			double u = 1 - std::exp(-x);
+			int bin = std::clamp((int)(u * num_bins), 0, num_bins - 1);
+			histogram(bin, event_type) += 1;
+			counts[event_type] += 1;
+			sums[event_type] += x;
+			sums_of_squares[event_type] += x * x;
+
+			int n = num_recent[event_type];
+			for (int lag = 1; lag <= std::min(n, max_lag); lag++) {
+				lag_products(lag - 1, event_type) += x * recent((n - lag) % max_lag, event_type);
+				lag_counts(lag - 1, event_type) += 1;
+			}
+			recent(n % max_lag, event_type) = x;
+			num_recent[event_type]++;
+		}
+
+		void merge(const TimeRescalingDiagnostics& other) {
+			histogram += other.histogram;
+			counts += other.counts;
+			sums += other.sums;
+			sums_of_squares += other.sums_of_squares;
+			lag_products += other.lag_products;
+			lag_counts += other.lag_counts;
+		}
+
+		//Empirical CDF of u at the upper bin edges k/num_bins; plotted against the edges this is the QQ curve for Uniform(0,1).
+		Eigen::VectorXd empirical_cdf(int event_type) const {
+			Eigen::VectorXd cdf(num_bins);
+			double total = 0;
+			for (int k = 0; k < num_bins; k++) {
+				total += histogram(k, event_type);
+				cdf[k] = counts[event_type] > 0 ? total / counts[event_type] : 0;
+			}
+			return cdf;
+		}
+
+		//Evaluated at the bin edges, so it understates the exact statistic by at most 1/num_bins.
+		REAL ks_statistic(int event_type) const {
+			Eigen::VectorXd cdf = empirical_cdf(event_type);
+			double statistic = 0;
+			for (int k = 0; k < num_bins; k++) {
+				statistic = std::max(statistic, std::abs(cdf[k] - (k + 1.0) / num_bins));
+			}
+			return statistic;
+		}
+
+		//Asymptotic Kolmogorov distribution with the Stephens small-sample correction.
+		REAL ks_p_value(int event_type) const {
+			double n = counts[event_type];
+			if (n == 0) {
+				return 1.0;
+			}
+			double lambda = (std::sqrt(n) + 0.12 + 0.11 / std::sqrt(n)) * ks_statistic(event_type);
+			return kolmogorov_survival(lambda);
+		}
+
+		Eigen::VectorXd autocorrelation(int event_type) const {
+			Eigen::VectorXd acf = Eigen::VectorXd::Constant(max_lag, 0.0);
+			double n = counts[event_type];
+			if (n < 2) {
+				return acf;
+			}
+			double mean = sums[event_type] / n;
+			double variance = sums_of_squares[event_type] / n - mean * mean;
+			for (int lag = 0; lag < max_lag; lag++) {
+				if (lag_counts(lag, event_type) > 0 && variance > 0) {
+					acf[lag] = (lag_products(lag, event_type) / lag_counts(lag, event_type) - mean * mean) / variance;
+				}
+			}
+			return acf;
+		}
+
+		REAL mean_residual(int event_type) const {
+			return counts[event_type] > 0 ? sums[event_type] / counts[event_type] : 0;
+		}
+
+		REAL count(int event_type) const {
+			return counts[event_type];
+		}
+
+		void print(std::ostream& os) const {
+			for (int i = 0; i < num_event_types; i++) {
+				if (counts[i] == 0) {
+					continue;
+				}
+				os << "type " << i << ": n=" << counts[i] << " mean=" << mean_residual(i) << " ks=" << ks_statistic(i) << " p=" << ks_p_value(i) << " acf=" << autocorrelation(i).transpose() << std::endl;
+			}
+		}
+
+		int num_event_types, num_bins, max_lag;
+
+	private:
+		Eigen::MatrixXd histogram;
+		Eigen::VectorXd counts, sums, sums_of_squares;
+		Eigen::MatrixXd lag_products, lag_counts;
+		Eigen::MatrixXd recent;
+		std::vector<int> num_recent;
+};
+
+//Feeds one session through a fitted kernel, turning compensator increments into residuals.
+void accumulate_time_rescaling(Kernel& kernel, Realisation& session, TimeRescalingDiagnostics& diagnostics) {
+	diagnostics.start_session();
+	Eigen::VectorXd previous = Eigen::VectorXd::Constant(kernel.num_event_types, 0.0);
+	for (const auto event : session) {
+		kernel.update(*event);
+		Eigen::VectorXd compensators = kernel.get_compensators();
+		diagnostics.observe(event->event_type, compensators[event->event_type] - previous[event->event_type]);
+		previous[event->event_type] = compensators[event->event_type];
+	}
+}
+
+/*
+ * Runs the diagnostics over many sessions on num_threads threads and merges the results.
+ * make_kernel(filename) must return a std::unique_ptr<Kernel> holding that session's fitted parameters and times;
+ * each thread owns its kernels, so no kernel state is shared.
+ */
+template <class KernelFactory>
+TimeRescalingDiagnostics run_time_rescaling_diagnostics(const std::vector<std::string>& filenames, KernelFactory make_kernel, int num_event_types, int num_threads=std::thread::hardware_concurrency(), int num_bins=1000, int max_lag=10) {
+	TimeRescalingDiagnostics total(num_event_types, num_bins, max_lag);
+	std::mutex total_mutex;
+	std::atomic<size_t> next_session(0);
+
+	auto worker = [&]() {
+		TimeRescalingDiagnostics local(num_event_types, num_bins, max_lag);
+		for (size_t i = next_session++; i < filenames.size(); i = next_session++) {
+			std::unique_ptr<Kernel> kernel = make_kernel(filenames[i]);
+			Realisation session(filenames[i]);
+			accumulate_time_rescaling(*kernel, session, local);
+		}
+		std::lock_guard<std::mutex> lock(total_mutex);
+		total.merge(local);
+	};
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < std::max(num_threads, 1); t++) {
+		threads.emplace_back(worker);
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	return total;
+}
+
+#endif //DIAGNOSTICS_H
@@ -0,0 +1,153 @@
+#ifndef DUAL_H
+#define DUAL_H
+
+#include <cmath>
+#include <Eigen/Dense>
+
+/*
+ * Second-order forward-mode dual number.
+ * Carries a value together with its gradient and Hessian with respect to N seeded variables,
+ * so any recursion written against it produces exact derivatives alongside the value.
+ * N should be a compile-time size where possible, so that Eigen keeps the derivative parts on the stack.
+ */
+template <int N>
+class HyperDual {
+	public:
+		using Gradient = Eigen::Matrix<double, N, 1>;
+		using Hessian = Eigen::Matrix<double, N, N>;
+
+		HyperDual(double value=0.0, int size=(N == Eigen::Dynamic ? 0 : N)) : value(value), gradient(Gradient::Zero(size)), hessian(Hessian::Zero(size, size)) {}
+
+		HyperDual(double value, const Gradient& gradient, const Hessian& hessian) : value(value), gradient(gradient), hessian(hessian) {}
+
+		//The index-th independent variable, with unit gradient in that direction.
+		static HyperDual variable(double value, int index, int size=(N == Eigen::Dynamic ? 0 : N)) {
+			HyperDual x(value, size);
+			x.gradient[index] = 1.0;
+			return x;
+		}
+
+		int size() const {
+			return gradient.size();
+		}
+
+		//Composition f(x) given f, f' and f'' evaluated at x.value.
+		HyperDual chain(double f, double df, double d2f) const {
+			return HyperDual(f, df * gradient, df * hessian + d2f * gradient * gradient.transpose());
+		}
+
+		HyperDual& operator+=(const HyperDual& other) {
+			value += other.value;
+			gradient += other.gradient;
+			hessian += other.hessian;
+			return *this;
+		}
+
+		HyperDual& operator-=(const HyperDual& other) {
+			value -= other.value;
+			gradient -= other.gradient;
+			hessian -= other.hessian;
+			return *this;
+		}
+
+		HyperDual& operator*=(double scale) {
+			value *= scale;
+			gradient *= scale;
+			hessian *= scale;
+			return *this;
+		}
+
+		HyperDual& operator+=(double shift) {
+			value += shift;
+			return *this;
+		}
+
+		double value;
+		Gradient gradient;
+		Hessian hessian;
+};
+
+template <int N>
+HyperDual<N> operator-(const HyperDual<N>& a) {
+	return HyperDual<N>(-a.value, -a.gradient, -a.hessian);
+}
+
+template <int N>
+HyperDual<N> operator+(HyperDual<N> a, const HyperDual<N>& b) {
+	return a += b;
+}
+
+template <int N>
+HyperDual<N> operator-(HyperDual<N> a, const HyperDual<N>& b) {
+	return a -= b;
+}
+
+template <int N>
+HyperDual<N> operator*(const HyperDual<N>& a, const HyperDual<N>& b) {
+	Eigen::Matrix<double, N, N> cross = a.gradient * b.gradient.transpose();
+	return HyperDual<N>(a.value * b.value, a.value * b.gradient + b.value * a.gradient, a.value * b.hessian + b.value * a.hessian + cross + cross.transpose());
+}
+
+template <int N>
+HyperDual<N> operator/(const HyperDual<N>& a, const HyperDual<N>& b) {
+	return a * b.chain(1.0 / b.value, -1.0 / (b.value * b.value), 2.0 / (b.value * b.value * b.value));
+}
+
+template <int N>
+HyperDual<N> operator+(HyperDual<N> a, double b) {
+	return a += b;
+}
+
+template <int N>
+HyperDual<N> operator+(double a, HyperDual<N> b) {
+	return b += a;
+}
+
+template <int N>
+HyperDual<N> operator-(HyperDual<N> a, double b) {
+	return a += -b;
+}
+
+template <int N>
+HyperDual<N> operator-(double a, const HyperDual<N>& b) {
+	return -b + a;
+}
+
+template <int N>
+HyperDual<N> operator*(HyperDual<N> a, double b) {
+	return a *= b;
+}
+
+template <int N>
+HyperDual<N> operator*(double a, HyperDual<N> b) {
+	return b *= a;
+}
+
+template <int N>
+HyperDual<N> operator/(HyperDual<N> a, double b) {
+	return a *= 1.0 / b;
+}
+
+template <int N>
+HyperDual<N> operator/(double a, const HyperDual<N>& b) {
+	return b.chain(a / b.value, -a / (b.value * b.value), 2.0 * a / (b.value * b.value * b.value));
+}
+
+template <int N>
+HyperDual<N> exp(const HyperDual<N>& a) {
+	double e = std::exp(a.value);
+	return a.chain(e, e, e);
+}
+
+template <int N>
+HyperDual<N> log(const HyperDual<N>& a) {
+	return a.chain(std::log(a.value), 1.0 / a.value, -1.0 / (a.value * a.value));
+}
+
+template <int N>
+HyperDual<N> sqrt(const HyperDual<N>& a) {
+	double s = std::sqrt(a.value);
+	return a.chain(s, 0.5 / s, -0.25 / (s * a.value));
+}
+
+#endif //DUAL_H
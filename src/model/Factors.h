@@ -0,0 +1,189 @@
+#ifndef FACTORS_H
+#define FACTORS_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <iostream>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+#include "Binning.h"
+
+/*
+ * Running mean, covariance and lagged cross-covariances of a stream of row vectors, fed a block of rows at a time.
+ * Lag 0 merges each block's centred scatter matrix into the total (Chan et al.), which stays accurate over billions
+ * of rows; lag l accumulates sum x_t x_{t-l}^T as one matrix product per block, carrying the last max_lag rows over
+ * block boundaries until break_series() starts a new series, so every pair is counted once and no more than a block
+ * is ever held.
+ */
+class StreamingCovariance {
+	public:
+		StreamingCovariance(int dimension, int max_lag=0) : dimension(dimension), max_lag(max_lag), running_mean(Eigen::VectorXd::Zero(dimension)), scatter(Eigen::MatrixXd::Zero(dimension, dimension)), lagged_products(max_lag + 1, Eigen::MatrixXd::Zero(dimension, dimension)), current_sums(max_lag + 1, Eigen::VectorXd::Zero(dimension)), lagged_sums(max_lag + 1, Eigen::VectorXd::Zero(dimension)), pair_counts(max_lag + 1, 0), tail(0, dimension) {}
+
+		template <class Block>
+		void update(const Eigen::MatrixBase<Block>& block) {
+			Eigen::MatrixXd rows = block.template cast<double>();
+			long n = rows.rows();
+			if (n == 0) {
+				return;
+			}
+			Eigen::RowVectorXd block_mean = rows.colwise().mean();
+			Eigen::MatrixXd centred = rows.rowwise() - block_mean;
+			Eigen::VectorXd delta = block_mean.transpose() - running_mean;
+			double total = count + n;
+			scatter.noalias() += centred.transpose() * centred;
+			scatter.noalias() += delta * delta.transpose() * ((double)count * n / total);
+			running_mean += delta * (n / total);
+			count += n;
+
+			if (max_lag > 0) {
+				Eigen::MatrixXd extended(tail.rows() + n, dimension);
+				extended << tail, rows;
+				long carried = tail.rows();
+				for (int lag = 1; lag <= max_lag; lag++) {
+					long first = std::max<long>(carried, lag);
+					long pairs = carried + n - first;
+					if (pairs <= 0) {
+						continue;
+					}
+					auto current = extended.middleRows(first, pairs);
+					auto lagged = extended.middleRows(first - lag, pairs);
+					lagged_products[lag].noalias() += current.transpose() * lagged;
+					current_sums[lag] += current.colwise().sum().transpose();
+					lagged_sums[lag] += lagged.colwise().sum().transpose();
+					pair_counts[lag] += pairs;
+				}
+				long keep = std::min<long>(max_lag, extended.rows());
+				tail = extended.bottomRows(keep);
+			}
+		}
+
+		//Ends the current series: the next block's first rows are not paired with this one's last rows at any lag.
+		void break_series() {
+			tail.resize(0, dimension);
+		}
+
+		const Eigen::VectorXd& mean() const {
+			return running_mean;
+		}
+
+		//Sample covariance (divided by count - 1).
+		Eigen::MatrixXd covariance() const {
+			return scatter / std::max<double>(count - 1, 1);
+		}
+
+		Eigen::MatrixXd correlation() const {
+			Eigen::VectorXd scale = covariance().diagonal().cwiseSqrt().cwiseInverse();
+			return scale.asDiagonal() * covariance() * scale.asDiagonal();
+		}
+
+		//Cov(x_t, x_{t-lag}), with each side centred on the mean of the rows that entered it.
+		Eigen::MatrixXd lagged_covariance(int lag) const {
+			if (lag == 0) {
+				return covariance();
+			}
+			double pairs = std::max<long>(pair_counts[lag], 1);
+			return lagged_products[lag] / pairs - (current_sums[lag] / pairs) * (lagged_sums[lag] / pairs).transpose();
+		}
+
+		long count = 0;
+		int dimension, max_lag;
+
+	private:
+		Eigen::VectorXd running_mean;
+		Eigen::MatrixXd scatter;
+		std::vector<Eigen::MatrixXd> lagged_products;
+		std::vector<Eigen::VectorXd> current_sums, lagged_sums;
+		std::vector<long> pair_counts;
+		Eigen::MatrixXd tail;
+};
+
+/*
+ * Rank-k PCA by incremental SVD (Ross et al. 2008, as in scikit-learn's IncrementalPCA): each block is centred on its
+ * own mean and stacked under the current k singular directions scaled by their singular values, plus one row for the
+ * shift in the mean, and the top k right singular vectors of that stack are the updated components. They are taken
+ * as the top eigenvectors of the stack's d x d Gram matrix, which costs one blocked product per block (the same as
+ * the covariance update) and a d x d eigensolve amortised over the block, instead of an SVD of a (k + rows + 1) x d
+ * matrix. Memory is O(d^2 + block d), and the result matches a batch PCA of everything seen up to the rank-k truncation.
+ */
+class StreamingPCA {
+	public:
+		StreamingPCA(int dimension, int rank) : dimension(dimension), rank(rank), running_mean(Eigen::VectorXd::Zero(dimension)), singular_values(0), basis(0, dimension) {}
+
+		template <class Block>
+		void update(const Eigen::MatrixBase<Block>& block) {
+			Eigen::MatrixXd rows = block.template cast<double>();
+			long n = rows.rows();
+			if (n == 0) {
+				return;
+			}
+			Eigen::RowVectorXd block_mean = rows.colwise().mean();
+			Eigen::MatrixXd centred = rows.rowwise() - block_mean;
+			Eigen::RowVectorXd shift = std::sqrt((double)count * n / (count + n)) * (running_mean.transpose() - block_mean);
+			Eigen::MatrixXd gram = basis.transpose() * singular_values.array().square().matrix().asDiagonal() * basis;
+			gram.noalias() += centred.transpose() * centred;
+			gram.noalias() += shift.transpose() * shift;
+			running_mean += (block_mean.transpose() - running_mean) * ((double)n / (count + n));
+			count += n;
+
+			//Eigenvalues come out ascending, so the leading components are the last columns.
+			Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigen(gram);
+			int kept = std::min(rank, dimension);
+			singular_values = eigen.eigenvalues().tail(kept).reverse().cwiseMax(0.0).cwiseSqrt();
+			basis = eigen.eigenvectors().rightCols(kept).rowwise().reverse().transpose();
+		}
+
+		//Principal directions as rows, largest variance first.
+		const Eigen::MatrixXd& components() const {
+			return basis;
+		}
+
+		Eigen::VectorXd explained_variance() const {
+			return singular_values.array().square() / std::max<double>(count - 1, 1);
+		}
+
+		const Eigen::VectorXd& mean() const {
+			return running_mean;
+		}
+
+		//Factor scores of a block of rows.
+		template <class Block>
+		Eigen::MatrixXd transform(const Eigen::MatrixBase<Block>& block) const {
+			return (block.template cast<double>().rowwise() - running_mean.transpose()) * basis.transpose();
+		}
+
+		long count = 0;
+		int dimension, rank;
+
+	private:
+		Eigen::VectorXd running_mean;
+		Eigen::VectorXd singular_values;
+		Eigen::MatrixXd basis;
+};
+
+/*
+ * Streams a binned count matrix (see run_event_binning) through both models block_rows rows at a time, straight
+ * from the mapped file, so only one block is resident however long the history. Sessions are taken from the .meta
+ * file and each is its own series, so lagged covariances never pair the end of one session with the start of the next.
+ */
+void fit_factor_model(const std::string& filename, StreamingCovariance& covariance, StreamingPCA& pca, size_t block_rows=65536) {
+	NpyMatrixView matrix(filename);
+	for (const BinnedSession& session : read_binning_sessions(filename)) {
+		if (session.first_row + session.num_bins > matrix.rows) {
+			std::cerr << session.path << " lies outside " << filename << std::endl;
+			continue;
+		}
+		covariance.break_series();
+		size_t end = session.first_row + session.num_bins;
+		for (size_t first = session.first_row; first < end; first += block_rows) {
+			auto block = matrix.block(first, std::min(block_rows, end - first));
+			covariance.update(block);
+			pca.update(block);
+		}
+	}
+}
+
+#endif //FACTORS_H
@@ -0,0 +1,347 @@
+#ifndef FEATURES_H
+#define FEATURES_H
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+#include "Book.h"
+
+enum FeatureKind {
+	SPREAD,
+	MICROPRICE,
+	//(bid - ask) / (bid + ask) over the top levels non-empty levels of each side.
+	TOP_IMBALANCE,
+	//Exponentially weighted mean of trade signs (+1 buyer-initiated, -1 seller-initiated).
+	TRADE_SIGN_EWMA,
+	//Exponentially weighted arrival rate of one event type, per second.
+	ARRIVAL_RATE,
+	//Exponentially weighted rate at which size leaves one side's touch through cancels and trades, per second.
+	QUEUE_DEPLETION
+};
+
+//One output column: levels applies to TOP_IMBALANCE, half_life (seconds) to the weighted features, event_type to
+//ARRIVAL_RATE and side to QUEUE_DEPLETION.
+struct FeatureSpec {
+	FeatureKind kind;
+	int levels = 1;
+	REAL half_life = 1;
+	int event_type = 0;
+	BookSide side = BID;
+
+	std::string name() const {
+		switch (kind) {
+			case SPREAD: return "spread";
+			case MICROPRICE: return "microprice";
+			case TOP_IMBALANCE: return "imbalance_" + std::to_string(levels);
+			case TRADE_SIGN_EWMA: return "trade_sign_" + std::to_string((double)half_life);
+			case ARRIVAL_RATE: return "rate_" + std::to_string(event_type) + "_" + std::to_string((double)half_life);
+			case QUEUE_DEPLETION: return std::string("depletion_") + (side == BID ? "bid_" : "ask_") + std::to_string((double)half_life);
+		}
+		return "";
+	}
+};
+
+/*
+ * Computes a configurable set of order-flow features incrementally, one event at a time, alongside book
+ * reconstruction: call before() with each event before the L2Book applies it (ReplayEngine::next(observer) gives that
+ * point) and update() after. Queue depletion is judged against the touch the event arrived to, since a cancel or
+ * trade that empties the best level moves the touch away. Weighted features decay continuously in time, so each
+ * update is O(1) per feature (O(levels) for imbalance) and nothing is allocated after construction.
+ */
+class FeatureExtractor {
+	public:
+		FeatureExtractor(const L2Book& book, std::vector<FeatureSpec> specs) : book(book), specs(specs), values(specs.size()), state(specs.size(), 0.0), weight(specs.size(), 0.0) {
+			values.setConstant(NAN);
+		}
+
+		//Records the touch each side had before the event.
+		void before(const Event& /*event*/) {
+			touch_before[BID] = book.touch(BID);
+			touch_before[ASK] = book.touch(ASK);
+		}
+
+		const Eigen::VectorXd& update(const Event& event) {
+			REAL elapsed = std::isnan((double)last_time) ? 0 : event.time - last_time;
+			last_time = event.time;
+			OrderAction action = event_action(event.event_type);
+			BookSide side = event_side(event.event_type);
+			bool has_order = event.marks.size() > ORDER_PRICE && !std::isnan(event.marks[ORDER_PRICE]);
+
+			for (size_t f = 0; f < specs.size(); f++) {
+				const FeatureSpec& spec = specs[f];
+				double decay = std::exp(-(double)(elapsed * std::log(2.0L) / spec.half_life));
+				switch (spec.kind) {
+					case SPREAD:
+						values[f] = book.empty(BID) || book.empty(ASK) ? NAN : book.to_price(book.best(ASK) - book.best(BID));
+						break;
+					case MICROPRICE:
+						values[f] = microprice();
+						break;
+					case TOP_IMBALANCE:
+						values[f] = imbalance(spec.levels);
+						break;
+					case TRADE_SIGN_EWMA:
+						//Decayed on every event, so the gap between two trades counts in full however many messages fall in it.
+						state[f] *= decay;
+						weight[f] *= decay;
+						if (action == TRADE) {
+							//Normalised by the decayed total weight, so early values are not shrunk towards zero.
+							state[f] += side == BID ? 1 : -1;
+							weight[f] += 1;
+							values[f] = state[f] / weight[f];
+						}
+						break;
+					case ARRIVAL_RATE:
+						state[f] = decay * state[f] + (event.event_type == spec.event_type ? std::log(2.0) / (double)spec.half_life : 0.0);
+						values[f] = state[f];
+						break;
+					case QUEUE_DEPLETION: {
+						double removed = 0;
+						if (has_order && book.to_tick(event.marks[ORDER_PRICE]) == touch_before[spec.side]) {
+							if ((action == CANCEL && side == spec.side) || (action == TRADE && side != spec.side)) {
+								removed = event.marks[ORDER_SIZE];
+							}
+						}
+						state[f] = decay * state[f] + removed * std::log(2.0) / (double)spec.half_life;
+						values[f] = state[f];
+						break;
+					}
+				}
+			}
+			return values;
+		}
+
+		std::vector<std::string> names() const {
+			std::vector<std::string> result;
+			for (const FeatureSpec& spec : specs) {
+				result.push_back(spec.name());
+			}
+			return result;
+		}
+
+		const Eigen::VectorXd& get_values() const {
+			return values;
+		}
+
+	private:
+		double microprice() const {
+			if (book.empty(BID) || book.empty(ASK)) {
+				return NAN;
+			}
+			double bid_size = book.depth(BID, 0), ask_size = book.depth(ASK, 0);
+			return (book.to_price(book.best(BID)) * ask_size + book.to_price(book.best(ASK)) * bid_size) / (bid_size + ask_size);
+		}
+
+		double imbalance(int levels) const {
+			double bid = 0, ask = 0;
+			for (int level = 0; level < levels; level++) {
+				bid += book.depth(BID, level);
+				ask += book.depth(ASK, level);
+			}
+			return bid + ask > 0 ? (bid - ask) / (bid + ask) : NAN;
+		}
+
+		const L2Book& book;
+		std::vector<FeatureSpec> specs;
+		Eigen::VectorXd values;
+		std::vector<double> state, weight;
+		REAL last_time = NAN;
+		long touch_before[2] = {0, 0};
+};
+
+/*
+ * Append-only memory-mapped columnar file of f64 features, one row per event, written in chunks of chunk_rows rows
+ * with each column contiguous inside a chunk, so the file grows without moving data and readers map it directly.
+ * Layout: a 4096-byte header of the magic bytes, u32 num_columns, u32 chunk_rows, u64 num_rows, then the
+ * NUL-terminated column names; then chunks of num_columns x chunk_rows f64. Column 0 is always the event time.
+ * From numpy: np.memmap(path, '<f8', offset=4096).reshape(-1, num_columns, chunk_rows).transpose(1, 0, 2)
+ * .reshape(num_columns, -1)[:, :num_rows].
+ */
+class FeatureFile {
+	public:
+		static constexpr size_t header_size = 4096;
+
+		//Creates (truncating) a file for writing.
+		FeatureFile(const std::string& filename, const std::vector<std::string>& feature_names, uint32_t chunk_rows=65536) : chunk_rows(chunk_rows), writable(true) {
+			column_names.push_back("time");
+			column_names.insert(column_names.end(), feature_names.begin(), feature_names.end());
+			num_columns = column_names.size();
+			descriptor = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+			if (descriptor < 0) {
+				std::cerr << "could not open " << filename << " for writing" << std::endl;
+				return;
+			}
+			map(header_size + chunk_bytes());
+			if (!data) {
+				return;
+			}
+			std::memcpy(data, magic, sizeof(magic));
+			std::memcpy(data + 8, &num_columns, sizeof(num_columns));
+			std::memcpy(data + 12, &chunk_rows, sizeof(chunk_rows));
+			char* name = data + 24;
+			for (const std::string& column : column_names) {
+				if (name + column.size() + 1 > data + header_size) {
+					std::cerr << "too many feature names for the header of " << filename << std::endl;
+					break;
+				}
+				std::memcpy(name, column.c_str(), column.size() + 1);
+				name += column.size() + 1;
+			}
+			set_num_rows(0);
+		}
+
+		//Opens an existing file read-only.
+		explicit FeatureFile(const std::string& filename) : writable(false) {
+			descriptor = ::open(filename.c_str(), O_RDONLY);
+			struct stat status;
+			if (descriptor < 0 || fstat(descriptor, &status) != 0 || (size_t)status.st_size < header_size) {
+				std::cerr << filename << " is not a feature file" << std::endl;
+				return;
+			}
+			map(status.st_size);
+			if (!data) {
+				return;
+			}
+			if (std::memcmp(data, magic, sizeof(magic)) != 0) {
+				std::cerr << filename << " is not a feature file" << std::endl;
+				unmap();
+				return;
+			}
+			std::memcpy(&num_columns, data + 8, sizeof(num_columns));
+			std::memcpy(&chunk_rows, data + 12, sizeof(chunk_rows));
+			const char* name = data + 24;
+			for (uint32_t c = 0; c < num_columns; c++) {
+				column_names.push_back(name);
+				name += column_names.back().size() + 1;
+			}
+		}
+
+		FeatureFile(const FeatureFile&) = delete;
+		FeatureFile& operator=(const FeatureFile&) = delete;
+
+		~FeatureFile() {
+			unmap();
+			if (descriptor >= 0) {
+				::close(descriptor);
+			}
+		}
+
+		void append(REAL time, const Eigen::VectorXd& features) {
+			uint64_t row = num_rows();
+			if (!data || !writable) {
+				return;
+			}
+			size_t needed = header_size + (row / chunk_rows + 1) * chunk_bytes();
+			if (needed > mapped_size) {
+				//Double the mapping so remapping is amortised over many rows.
+				unmap();
+				map(std::max(needed, 2 * (needed - header_size) + header_size));
+			}
+			double* chunk = chunk_start(row);
+			size_t within = row % chunk_rows;
+			chunk[within] = time;
+			for (uint32_t c = 1; c < num_columns; c++) {
+				chunk[c * chunk_rows + within] = features[c - 1];
+			}
+			set_num_rows(row + 1);
+		}
+
+		uint64_t num_rows() const {
+			uint64_t rows = 0;
+			if (data) {
+				std::memcpy(&rows, data + 16, sizeof(rows));
+			}
+			return rows;
+		}
+
+		int column(const std::string& name) const {
+			auto found = std::find(column_names.begin(), column_names.end(), name);
+			return found == column_names.end() ? -1 : found - column_names.begin();
+		}
+
+		double get(uint64_t row, int column) const {
+			return chunk_start(row)[column * chunk_rows + row % chunk_rows];
+		}
+
+		//Writes a row's features into marks from offset on (by default after the BookMark columns), for kernels that read them as marks.
+		void fill_marks(uint64_t row, Eigen::VectorXd& marks, int offset=NUM_BOOK_MARKS) const {
+			if (marks.size() < offset + num_columns - 1) {
+				marks.conservativeResize(offset + num_columns - 1);
+			}
+			for (uint32_t c = 1; c < num_columns; c++) {
+				marks[offset + c - 1] = get(row, c);
+			}
+		}
+
+		//Releases the unused tail of the last chunk's mapping and flushes to disk.
+		void close() {
+			if (data && writable) {
+				size_t used = header_size + (num_rows() + chunk_rows - 1) / chunk_rows * chunk_bytes();
+				msync(data, mapped_size, MS_SYNC);
+				unmap();
+				if (ftruncate(descriptor, std::max(used, header_size)) != 0) {
+					std::cerr << "could not truncate feature file" << std::endl;
+				}
+			}
+		}
+
+		std::vector<std::string> column_names;
+		uint32_t num_columns = 0, chunk_rows = 0;
+
+	private:
+		static constexpr char magic[8] = {'O', 'B', 'S', 'F', 'E', 'A', 'T', '1'};
+
+		size_t chunk_bytes() const {
+			return (size_t)num_columns * chunk_rows * sizeof(double);
+		}
+
+		double* chunk_start(uint64_t row) const {
+			return reinterpret_cast<double*>(data + header_size + row / chunk_rows * chunk_bytes());
+		}
+
+		void set_num_rows(uint64_t rows) {
+			std::memcpy(data + 16, &rows, sizeof(rows));
+		}
+
+		void map(size_t size) {
+			if (writable && ftruncate(descriptor, size) != 0) {
+				std::cerr << "could not grow feature file" << std::endl;
+				return;
+			}
+			void* address = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, descriptor, 0);
+			if (address == MAP_FAILED) {
+				std::cerr << "could not map feature file" << std::endl;
+				return;
+			}
+			data = static_cast<char*>(address);
+			mapped_size = size;
+		}
+
+		void unmap() {
+			if (data) {
+				munmap(data, mapped_size);
+				data = nullptr;
+				mapped_size = 0;
+			}
+		}
+
+		int descriptor = -1;
+		char* data = nullptr;
+		size_t mapped_size = 0;
+		bool writable;
+};
+
+#endif //FEATURES_H
@@ -0,0 +1,218 @@
+#ifndef HESSIAN_H
+#define HESSIAN_H
+
+#include <algorithm>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+
+enum HessianStructure {
+	DIAGONAL,
+	BLOCK_DIAGONAL,
+	BANDED,
+	DENSE
+};
+
+/*
+ * Symmetric Hessian stored as only its non-zero structure, with a solver to match:
+ *	DIAGONAL: data is n x 1
+ *	BLOCK_DIAGONAL: data is block_size x n, the diagonal blocks side by side
+ *	BANDED: data is (bandwidth + 1) x n, data(k, j) = H(j + k, j) for the lower band
+ *	DENSE: data is n x n, only the lower triangle is read
+ * Directions that carry no information (a zero diagonal entry or an all-zero block) get a zero step instead of a NaN,
+ * which is what happens for states or buckets that a session never visits.
+ */
+class StructuredHessian {
+	public:
+		StructuredHessian(HessianStructure structure, int width, Eigen::MatrixXd data) : structure(structure), width(width), data(data) {}
+
+		static StructuredHessian diagonal(Eigen::VectorXd diagonal) {
+			return StructuredHessian(DIAGONAL, 1, diagonal);
+		}
+
+		static StructuredHessian block_diagonal(int block_size, Eigen::MatrixXd blocks) {
+			return StructuredHessian(BLOCK_DIAGONAL, block_size, blocks);
+		}
+
+		static StructuredHessian banded(int bandwidth, Eigen::MatrixXd band) {
+			return StructuredHessian(BANDED, bandwidth, band);
+		}
+
+		static StructuredHessian dense(Eigen::MatrixXd hessian) {
+			return StructuredHessian(DENSE, hessian.rows(), hessian);
+		}
+
+		int size() const {
+			return structure == DIAGONAL ? data.rows() : data.cols();
+		}
+
+		Eigen::MatrixXd to_dense() const {
+			int n = size();
+			Eigen::MatrixXd hessian = Eigen::MatrixXd::Constant(n, n, 0.0);
+			switch (structure) {
+				case DIAGONAL:
+					hessian.diagonal() = data.col(0);
+					break;
+				case BLOCK_DIAGONAL:
+					for (int b = 0; b < n; b += width) {
+						hessian.block(b, b, width, width) = data.middleCols(b, width);
+					}
+					break;
+				case BANDED:
+					for (int j = 0; j < n; j++) {
+						for (int k = 0; k <= width && j + k < n; k++) {
+							hessian(j + k, j) = hessian(j, j + k) = data(k, j);
+						}
+					}
+					break;
+				case DENSE:
+					hessian = data.selfadjointView<Eigen::Lower>();
+					break;
+			}
+			return hessian;
+		}
+
+		//The diagonal read straight from the stored structure, without building the dense matrix.
+		Eigen::VectorXd diagonal() const {
+			switch (structure) {
+				case DIAGONAL:
+					return data.col(0);
+				case BLOCK_DIAGONAL: {
+					Eigen::VectorXd result(size());
+					for (int b = 0; b < size(); b += width) {
+						result.segment(b, width) = data.middleCols(b, width).diagonal();
+					}
+					return result;
+				}
+				case BANDED:
+					return data.row(0).transpose();
+				case DENSE:
+					return data.diagonal();
+			}
+			return Eigen::VectorXd(0);
+		}
+
+		void add_to_diagonal(REAL shift) {
+			switch (structure) {
+				case DIAGONAL:
+					data.array() += (double)shift;
+					break;
+				case BLOCK_DIAGONAL:
+					for (int b = 0; b < size(); b += width) {
+						data.middleCols(b, width).diagonal().array() += (double)shift;
+					}
+					break;
+				case BANDED:
+					data.row(0).array() += (double)shift;
+					break;
+				case DENSE:
+					data.diagonal().array() += (double)shift;
+					break;
+			}
+		}
+
+		Eigen::VectorXd multiply(const Eigen::VectorXd& v) const {
+			switch (structure) {
+				case DIAGONAL:
+					return data.col(0).cwiseProduct(v);
+				case BLOCK_DIAGONAL: {
+					Eigen::VectorXd product(v.size());
+					for (int b = 0; b < size(); b += width) {
+						product.segment(b, width) = data.middleCols(b, width) * v.segment(b, width);
+					}
+					return product;
+				}
+				case BANDED: {
+					Eigen::VectorXd product = data.row(0).transpose().cwiseProduct(v);
+					for (int j = 0; j < size(); j++) {
+						for (int k = 1; k <= width && j + k < size(); k++) {
+							product[j + k] += data(k, j) * v[j];
+							product[j] += data(k, j) * v[j + k];
+						}
+					}
+					return product;
+				}
+				case DENSE: {
+					//Column by column through the lower triangle; Eigen's selfadjoint and triangular products leave a
+					//buffer that GCC 12 reports as maybe-uninitialized.
+					Eigen::VectorXd product = data.diagonal().cwiseProduct(v);
+					for (int j = 0; j + 1 < size(); j++) {
+						int below = size() - j - 1;
+						product.tail(below) += data.col(j).tail(below) * v[j];
+						product[j] += data.col(j).tail(below).dot(v.tail(below));
+					}
+					return product;
+				}
+			}
+			return v;
+		}
+
+		//Solves H x = rhs.
+		Eigen::VectorXd solve(const Eigen::VectorXd& rhs) const {
+			switch (structure) {
+				case DIAGONAL:
+					return (data.col(0).array() != 0).select(rhs.cwiseQuotient(data.col(0)), 0.0);
+				case BLOCK_DIAGONAL: {
+					Eigen::VectorXd x(rhs.size());
+					for (int b = 0; b < size(); b += width) {
+						auto block = data.middleCols(b, width);
+						if (block.isZero()) {
+							x.segment(b, width).setZero();
+						} else {
+							x.segment(b, width) = block.ldlt().solve(rhs.segment(b, width));
+						}
+					}
+					return x;
+				}
+				case BANDED:
+					return solve_banded(rhs);
+				case DENSE:
+					return data.ldlt().solve(rhs);
+			}
+			return rhs;
+		}
+
+		HessianStructure structure;
+		int width;
+		Eigen::MatrixXd data;
+
+	private:
+		//Band-limited LDL^T without pivoting, O(n * bandwidth^2), for a definite H of either sign.
+		Eigen::VectorXd solve_banded(const Eigen::VectorXd& rhs) const {
+			int n = size();
+			Eigen::MatrixXd factor = data;
+			Eigen::VectorXd d(n);
+			for (int j = 0; j < n; j++) {
+				d[j] = factor(0, j);
+				for (int k = std::max(0, j - width); k < j; k++) {
+					d[j] -= factor(j - k, k) * factor(j - k, k) * d[k];
+				}
+				for (int i = j + 1; i <= std::min(n - 1, j + width); i++) {
+					double value = factor(i - j, j);
+					for (int k = std::max(0, i - width); k < j; k++) {
+						value -= factor(i - k, k) * factor(j - k, k) * d[k];
+					}
+					factor(i - j, j) = d[j] != 0 ? value / d[j] : 0;
+				}
+			}
+
+			Eigen::VectorXd x = rhs;
+			for (int i = 0; i < n; i++) {
+				for (int k = std::max(0, i - width); k < i; k++) {
+					x[i] -= factor(i - k, k) * x[k];
+				}
+			}
+			for (int i = 0; i < n; i++) {
+				x[i] = d[i] != 0 ? x[i] / d[i] : 0;
+			}
+			for (int i = n - 1; i >= 0; i--) {
+				for (int k = i + 1; k <= std::min(n - 1, i + width); k++) {
+					x[i] -= factor(k - i, i) * x[k];
+				}
+			}
+			return x;
+		}
+};
+
+#endif //HESSIAN_H
@@ -0,0 +1,58 @@
+#ifndef INTENSITYGRID_H
+#define INTENSITYGRID_H
+
+#include <vector>
+#include <cassert>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+#include "Kernel.h"
+
+inline const Event& event_ref(const Event& event) {
+	return event;
+}
+
+inline const Event& event_ref(const Event* event) {
+	return *event;
+}
+
+/*
+ * Evaluates lambda(t) for every t in the sorted query times, writing a times x types matrix into out.
+ * Events and queries are merged in a single sweep: all queries up to the next event are handed to the kernel at once
+ * through get_intensities_at, so kernels with shared decay evaluate the whole run of queries as one vectorised
+ * expression. Intensities are left-continuous, so a query at an event's time does not see that event.
+ * events can be a Realisation or any range of Event; the kernel should be freshly reset and is left after the last query.
+ */
+template <class EventRange>
+void evaluate_intensity_grid(Kernel& kernel, EventRange& events, const std::vector<REAL>& times, Eigen::Ref<Eigen::MatrixXd> out) {
+	assert(out.rows() == (int)times.size() && out.cols() == kernel.num_event_types);
+
+	size_t next_query = 0;
+	auto emit_until = [&](size_t last) {
+		if (last > next_query) {
+			Eigen::VectorXd offsets(last - next_query);
+			for (size_t k = next_query; k < last; k++) {
+				offsets[k - next_query] = times[k] - kernel.current_time;
+			}
+			kernel.get_intensities_at(offsets, out.middleRows(next_query, last - next_query));
+			next_query = last;
+		}
+	};
+
+	for (const auto& event : events) {
+		const Event& observation = event_ref(event);
+		size_t last = next_query;
+		while (last < times.size() && times[last] <= observation.time) {
+			last++;
+		}
+		emit_until(last);
+		if (next_query == times.size()) {
+			break;
+		}
+		kernel.update(observation);
+	}
+	emit_until(times.size());
+}
+
+#endif //INTENSITYGRID_H
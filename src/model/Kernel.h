@@ -1,11 +1,18 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
 #include <utility>
 #include <random>
 #include <cmath>
 #include <algorithm>
+#include <numeric>
+#include <vector>
+#include <cassert>
 
 #include <Eigen/Dense>
 
 #include "Types.h"
+#include "Hessian.h"
 
 std::random_device rd;
 std::mt19937 generator(rd());
@@ -24,16 +31,47 @@ std::mt19937 generator(rd());
 
 class Kernel {
 	public:
-		Kernel(int num_event_types, REAL start_time, REAL end_time) : num_event_types(num_event_types), start_time(start_time), end_time(end_time) {
+		Kernel(int num_event_types, REAL start_time, REAL end_time) : start_time(start_time), end_time(end_time), num_event_types(num_event_types) {
 			reset();
 		}
 
+		virtual ~Kernel() {}
+
 		virtual std::pair<Eigen::MatrixXd,Eigen::VectorXd> get_hessian_and_gradient() = 0;
 
+		//Kernels that know the sparsity of their Hessian override this so solvers never build or factor the dense matrix.
+		virtual std::pair<StructuredHessian,Eigen::VectorXd> get_structured_hessian_and_gradient() {
+			auto [hessian, gradient] = get_hessian_and_gradient();
+			return {StructuredHessian::dense(hessian), gradient};
+		}
+
+		//Log-likelihood of the events seen since reset() over [start_time, end_time], at the current parameters.
+		virtual REAL get_log_likelihood() = 0;
+
 		virtual Eigen::VectorXd get_params() = 0;
 
 		virtual void set_params(Eigen::VectorXd new_params) = 0;
 
+		//Box constraints on the parameters, e.g. zero for background rates; unbounded by default.
+		virtual Eigen::VectorXd get_lower_bounds() {
+			return Eigen::VectorXd::Constant(get_params().size(), -INFINITY);
+		}
+
+		virtual Eigen::VectorXd get_upper_bounds() {
+			return Eigen::VectorXd::Constant(get_params().size(), INFINITY);
+		}
+
+		//False for kernels whose accumulated statistics (counts, exposures) do not depend on the parameters, so a refit
+		//can keep them across set_params instead of passing over the data again.
+		virtual bool statistics_depend_on_params() {
+			return true;
+		}
+
+		//Parameter-free summary of the data seen since reset(), for kernels that have one; persisted alongside fits.
+		virtual Eigen::VectorXd get_sufficient_statistics() {
+			return Eigen::VectorXd(0);
+		}
+
 		//Return a time and event type label
 		std::pair<REAL,int> simulate() {
 			return {0.0,0};
@@ -65,25 +103,41 @@ class Kernel {
 		}
 
 		REAL get_intensity() {
-			Eigen::VectorXd intensities = get_intensities();
-			return std::accumulate(intensities.begin(), intensities.end(), 0);
+			return get_intensities().sum();
 		}
 
 		virtual Eigen::VectorXd get_intensities() = 0;
 
+		//Intensities at current_time + offsets[k] into row k of out, assuming no further events arrive. offsets must be non-negative.
+		virtual void get_intensities_at(const Eigen::VectorXd& offsets, Eigen::Ref<Eigen::MatrixXd> out) {
+			assert((offsets.array() >= 0).all());
+			REAL time = current_time;
+			for (int k = 0; k < offsets.size(); k++) {
+				current_time = time + offsets[k];
+				out.row(k) = get_intensities().transpose();
+			}
+			current_time = time;
+		}
+
+		//Integral of each event type's intensity from start_time to current_time.
+		virtual Eigen::VectorXd get_compensators() = 0;
+
 		void progress_time(REAL timediff) {
 			current_time += timediff;
 		}
 
 		virtual void update(Event observation, REAL weight=1.0) = 0;
 
+		//Scales every accumulated sufficient statistic by factor, so that earlier observations are exponentially forgotten.
+		virtual void discount(REAL factor) = 0;
+
 		void parameter_step(Eigen::VectorXd diff) {
 			set_params(get_params() + diff);
 		}
 
 		virtual REAL get_intensity_upper_bound() = 0;
 
-		void reset() {
+		virtual void reset() {
 			current_time = start_time;
 		};
 
@@ -91,26 +145,50 @@ class Kernel {
 		int num_event_types;
 };
 
-class PoissonKernel : Kernel {
+class PoissonKernel : public Kernel {
 	public:
 		PoissonKernel(int num_event_types, REAL start_time, REAL end_time) : Kernel(num_event_types, start_time, end_time) {
-			nu = Eigen::VectorXd::Random(num_event_types) + 2.0;
+			nu = Eigen::VectorXd::Random(num_event_types).array() + 2.0;
 			weighted_event_counts = Eigen::VectorXd::Constant(num_event_types,0.0);
 		}
 
 		std::pair<Eigen::MatrixXd,Eigen::VectorXd> get_hessian_and_gradient() {
+			auto [hessian, gradient] = get_structured_hessian_and_gradient();
+			return {hessian.to_dense(), gradient};
+		}
+
+		std::pair<StructuredHessian,Eigen::VectorXd> get_structured_hessian_and_gradient() {
 			Eigen::VectorXd gradient = weighted_event_counts.cwiseProduct(nu.cwiseInverse());
-			gradient.array() -= end_time-start_time;
+			gradient.array() -= (double)(end_time-start_time);
+
+			Eigen::VectorXd hessian = nu.cwiseProduct(nu).cwiseInverse().cwiseProduct(-weighted_event_counts);
 
-			Eigen::MatrixXd hessian = (nu.cwiseProduct(nu).cwiseInverse().cwiseProduct(-weighted_event_counts)).asDiagonal();
+			return {StructuredHessian::diagonal(hessian), gradient};
+		}
 
-			return {hessian, gradient};
+		REAL get_log_likelihood() {
+			return weighted_event_counts.dot(nu.array().log().matrix()) - nu.sum() * (end_time - start_time);
 		}
 
 		Eigen::VectorXd get_params() {
 			return nu;
 		}
 
+		bool statistics_depend_on_params() {
+			return false;
+		}
+
+		//Weighted counts per type, then the exposure.
+		Eigen::VectorXd get_sufficient_statistics() {
+			Eigen::VectorXd statistics(num_event_types + 1);
+			statistics << weighted_event_counts, (double)(end_time - start_time);
+			return statistics;
+		}
+
+		Eigen::VectorXd get_lower_bounds() {
+			return Eigen::VectorXd::Constant(num_event_types, 0.0);
+		}
+
 		void set_params(Eigen::VectorXd new_params) {
 			nu = new_params;
 		}
@@ -119,12 +197,26 @@ class PoissonKernel : Kernel {
 			return nu;
 		}
 
+		void get_intensities_at(const Eigen::VectorXd& /*offsets*/, Eigen::Ref<Eigen::MatrixXd> out) {
+			out.rowwise() = nu.transpose();
+		}
+
+		Eigen::VectorXd get_compensators() {
+			return nu * (double)(current_time - start_time);
+		}
+
 		void update(Event observation, REAL weight=1.0) {
 			REAL timediff = observation.time - current_time;
 			weighted_event_counts.array()[observation.event_type] += weight;
 			progress_time(timediff);
 		}
 
+		void discount(REAL factor) {
+			//Exposure is end_time - start_time, so it is discounted by moving the start of the window.
+			weighted_event_counts *= (double)factor;
+			start_time = current_time - factor * (current_time - start_time);
+		}
+
 		REAL get_intensity_upper_bound() {
 			return get_intensity();
 		}
@@ -138,113 +230,217 @@ class PoissonKernel : Kernel {
 		Eigen::VectorXd weighted_event_counts;
 };
 
-class ExpHawkesKernel : Kernel {
+//Maps the book marks of an event onto a flat state index (spread ticks x imbalance bucket x queue-size bucket).
+class BookStateDiscretiser {
 	public:
-		ExpHawkesKernel(int num_event_types) : Kernel(num_event_types) {
-			alpha = Eigen::MatrixXd::Random(num_event_types, num_event_types) + 2.0;
-			beta = 2*alpha;
+		BookStateDiscretiser(REAL tick_size, int max_spread_ticks, std::vector<REAL> imbalance_edges, std::vector<REAL> queue_edges) : tick_size(tick_size), max_spread_ticks(max_spread_ticks), imbalance_edges(imbalance_edges), queue_edges(queue_edges) {
+			num_imbalance_buckets = imbalance_edges.size() + 1;
+			num_queue_buckets = queue_edges.size() + 1;
 		}
 
-		std::pair<Eigen::MatrixXd,Eigen::VectorXd> get_hessian_and_gradient() {
+		int num_states() const {
+			return max_spread_ticks * num_imbalance_buckets * num_queue_buckets;
 		}
 
-		Eigen::VectorXd get_params() {
-		}
+		int get_state(const Eigen::VectorXd& marks) const {
+			if (marks.size() <= ASK_PRICE) {
+				return 0;
+			}
+			REAL bq = std::isnan(marks[BID_SIZE]) ? 0 : marks[BID_SIZE];
+			REAL aq = std::isnan(marks[ASK_SIZE]) ? 0 : marks[ASK_SIZE];
+
+			//A one-sided book has no spread, so it is lumped in with the widest spread bucket.
+			int spread_bucket = max_spread_ticks - 1;
+			REAL spread = marks[ASK_PRICE] - marks[BID_PRICE];
+			if (!std::isnan(spread)) {
+				int ticks = (int)std::lround(spread / tick_size);
+				spread_bucket = std::clamp(ticks, 1, max_spread_ticks) - 1;
+			}
 
-		void set_params(Eigen::VectorXd new_params) {
-		}
+			REAL imbalance = bq + aq > 0 ? (bq - aq) / (bq + aq) : 0;
+			int imbalance_bucket = std::upper_bound(imbalance_edges.begin(), imbalance_edges.end(), imbalance) - imbalance_edges.begin();
+			int queue_bucket = std::upper_bound(queue_edges.begin(), queue_edges.end(), std::min(bq, aq)) - queue_edges.begin();
 
-		Eigen::VectorXd get_intensities() {
-			return intensity_matrix.rowwise().sum();
+			return (spread_bucket * num_imbalance_buckets + imbalance_bucket) * num_queue_buckets + queue_bucket;
 		}
 
-		void reset() {
-			current_time = start_time;
-			intensity_matrix = Eigen::MatrixXd::Constant(num_event_types, num_event_types, 0.0);
-			time_ema_matrix = Eigen::MatrixXd::Constant(num_event_types, num_event_types, 0.0);
-			alpha_gradient = Eigen::MatrixXd::Constant(num_event_types, num_event_types, 0.0);
-			beta_gradient = Eigen::MatrixXd::Constant(num_event_types, num_event_types, 0.0);
-		};
+	private:
+		REAL tick_size;
+		int max_spread_ticks, num_imbalance_buckets, num_queue_buckets;
+		std::vector<REAL> imbalance_edges, queue_edges;
+};
 
-		void update(Event observation, REAL weight=1.0) {
-			if (weight != 0) {
-				REAL timediff = observation.time - current_time;
-				weighted_event_counts.array()[observation.event_type] += weight;
-				progress_time(timediff);
+/*
+ * lambda_i(t) = nu_{i,s(t)} + sum_j alpha_{i,j,s(t)} R_j(t), with R_j(t) = sum_{t_k<t, type j} exp(-beta (t - t_k))
+ * s(t) is the book state after the most recent event and beta is held fixed, so the log-likelihood is concave in (nu, alpha).
+ * Parameters are stored as one column [nu, alpha_{i,0..d-1}] per (state, target type), so a state lookup is a contiguous column.
+ * Only the column of the observed (state, type) is touched per event, making the cost O(d^2) regardless of the number of states.
+ */
+class StateDependentHawkesKernel : public Kernel {
+	public:
+		StateDependentHawkesKernel(int num_event_types, REAL start_time, REAL end_time, BookStateDiscretiser discretiser, REAL beta) : Kernel(num_event_types, start_time, end_time), discretiser(discretiser), beta(beta) {
+			num_states = discretiser.num_states();
+			block_size = num_event_types + 1;
 
-				intensity_matrix.array() *= (-beta*timediff).array().exp();
-				intensity_matrix += alpha;
+			coef = Eigen::MatrixXd::Constant(block_size, num_states * num_event_types, 0.0);
+			coef.row(0) = Eigen::VectorXd::Random(num_states * num_event_types).transpose().array() + 2.0;
+			coef.bottomRows(num_event_types) = (Eigen::MatrixXd::Random(num_event_types, num_states * num_event_types).array() + 1.0) * (0.5 * beta / num_event_types);
 
-				time_ema_matrix.array() *= (-beta*timediff).array().exp();
-				time_ema_matrix += alpha*observation.time;
-			}
+			reset();
 		}
 
-		REAL get_intensity_upper_bound() {
-			return std::max(0,get_intensity());
+		std::pair<Eigen::MatrixXd,Eigen::VectorXd> get_hessian_and_gradient() {
+			auto [hessian, gradient] = get_structured_hessian_and_gradient();
+			return {hessian.to_dense(), gradient};
 		}
-	private:
-		Eigen::MatrixXd alpha, beta, intensity_matrix, time_ema_matrix, alpha_gradient, beta_gradient, alpha_hessian_diag, beta_hessian_diag, hessian_crossterm;
-}
 
-class LinearSplineBackgroundKernel : Kernel {
-	public:
-		LinearSpline(int num_event_types, REAL start_time, REAL end_time) : Kernel(num_event_types), start_time(start_time), end_time(end_time) {
-			coef = Eigen::VectorXd::Random(num_event_types) + 2.0;
+		std::pair<StructuredHessian,Eigen::VectorXd> get_structured_hessian_and_gradient() {
+			Eigen::MatrixXd total_exposure = get_total_exposure();
 
-			std::uniform_real_distribution<REAL> unif_distribution(start_time,end_time);
-			knot = unif_distribution(generator);
+			int num_params = coef.size();
+			Eigen::VectorXd gradient(num_params);
+			Eigen::MatrixXd hessian(block_size, num_params);
+			for (int b = 0; b < num_states * num_event_types; b++) {
+				gradient.segment(b * block_size, block_size) = weighted_score_sums.col(b) - total_exposure.col(b / num_event_types);
+				hessian.middleCols(b * block_size, block_size) = -hessian_blocks[b];
+			}
 
-			weighted_event_counts = Eigen::VectorXd::Constant(num_event_types,0.0);
+			return {StructuredHessian::block_diagonal(block_size, hessian), gradient};
 		}
 
-		std::pair<Eigen::MatrixXd,Eigen::VectorXd> get_hessian_and_gradient() {
-			Eigen::VectorXd gradient_coef = weighted_event_counts.cwiseProduct(coef.cwiseInverse()) - 0.5 * (end_time - knot)**2;
-			REAL gradient_knot = - weighted_max_reciprocal_sum_after_knot + (end_time - knot) * coef.sum();
-			Eigen::VectorXd hessian_coef_coef = - weighted_event_counts.cwiseProduct(coef.cwiseProduct(coef).cwiseInverse());
-			Eigen::VectorXd hessian_coef_knot = Eigen::VectorXd::Constant(num_event_types,end_time - knot);
-			REAL hessian_knot_knot = weighted_maxsquared_reciprocal_sum_after_knot - coef.sum();
-
-			weighted_event_counts.cwiseProduct(a.cwiseInverse()) - 1;
-			
-			Eigen::VectorXd gradient = weighted_event_counts.cwiseProduct(nu.cwiseInverse());
-			gradient.array() -= end_time-start_time;
-
-			Eigen::MatrixXd hessian = (nu.cwiseProduct(nu).cwiseInverse().cwiseProduct(-weighted_event_counts)).asDiagonal();
-
-			return {hessian, gradient};
+		REAL get_log_likelihood() {
+			Eigen::MatrixXd total_exposure = get_total_exposure();
+			REAL compensator = 0;
+			for (int b = 0; b < num_states * num_event_types; b++) {
+				compensator += coef.col(b).dot(total_exposure.col(b / num_event_types));
+			}
+			return weighted_log_intensity_sum - compensator;
 		}
 
 		Eigen::VectorXd get_params() {
+			return Eigen::Map<Eigen::VectorXd>(coef.data(), coef.size());
+		}
+
+		//Backgrounds must be non-negative; excitations may be negative as long as the intensity stays positive.
+		Eigen::VectorXd get_lower_bounds() {
+			Eigen::MatrixXd bounds = Eigen::MatrixXd::Constant(block_size, num_states * num_event_types, -INFINITY);
+			bounds.row(0).setZero();
+			return Eigen::Map<Eigen::VectorXd>(bounds.data(), bounds.size());
 		}
 
 		void set_params(Eigen::VectorXd new_params) {
+			coef = Eigen::Map<Eigen::MatrixXd>(new_params.data(), block_size, num_states * num_event_types);
 		}
 
 		Eigen::VectorXd get_intensities() {
+			Eigen::VectorXd features(block_size);
+			features[0] = 1.0;
+			features.tail(num_event_types) = excitation * std::exp(-beta * (current_time - last_event_time));
+			return coef.middleCols(state * num_event_types, num_event_types).transpose() * features;
+		}
+
+		//The state is fixed until the next event, so every query is the background plus one shared excitation vector times its decay.
+		void get_intensities_at(const Eigen::VectorXd& offsets, Eigen::Ref<Eigen::MatrixXd> out) {
+			auto block = coef.middleCols(state * num_event_types, num_event_types);
+			Eigen::VectorXd excited = block.bottomRows(num_event_types).transpose() * excitation;
+			Eigen::VectorXd decay = (-(double)beta * (offsets.array() + (double)(current_time - last_event_time))).exp().matrix();
+			out.noalias() = decay * excited.transpose();
+			out.rowwise() += block.row(0);
+		}
+
+		Eigen::VectorXd get_compensators() {
+			return compensator + interval_compensators(current_time - last_event_time);
 		}
 
 		void update(Event observation, REAL weight=1.0) {
-			REAL timediff = observation.time - current_time;
-			weighted_event_counts.array()[observation.event_type] += weight;
-			progress_time(timediff);
+			REAL timediff = observation.time - last_event_time;
+			if (timediff > 0) {
+				compensator += interval_compensators(timediff);
+				exposure(0, state) += timediff;
+				exposure.col(state).tail(num_event_types) += decayed_integral(timediff);
+				excitation *= std::exp(-beta * timediff);
+			}
+			progress_time(observation.time - current_time);
+			last_event_time = observation.time;
+
+			if (weight != 0) {
+				int b = state * num_event_types + observation.event_type;
+				Eigen::VectorXd features(block_size);
+				features[0] = 1.0;
+				features.tail(num_event_types) = excitation;
+				REAL intensity = coef.col(b).dot(features);
+
+				weighted_log_intensity_sum += weight * std::log(intensity);
+				weighted_score_sums.col(b) += weight / intensity * features;
+				hessian_blocks[b].noalias() += weight / (intensity * intensity) * features * features.transpose();
+
+				excitation[observation.event_type] += weight;
+			}
+
+			state = discretiser.get_state(observation.marks);
+		}
+
+		void discount(REAL factor) {
+			weighted_log_intensity_sum *= factor;
+			exposure *= (double)factor;
+			weighted_score_sums *= (double)factor;
+			for (Eigen::MatrixXd& block : hessian_blocks) {
+				block *= (double)factor;
+			}
 		}
 
 		REAL get_intensity_upper_bound() {
-			//This is quite inefficient for simulation purposes. Maybe write a custom simulation method for this subclass.
+			//Excitation only decays until the next event, so positive terms at the current time bound the future.
+			Eigen::VectorXd features(block_size);
+			features[0] = 1.0;
+			features.tail(num_event_types) = excitation * std::exp(-beta * (current_time - last_event_time));
+			return (coef.middleCols(state * num_event_types, num_event_types).cwiseMax(0.0).transpose() * features).sum();
 		}
 
 		void reset() {
 			current_time = start_time;
-			weighted_event_counts = Eigen::VectorXd::Constant(num_event_types, 0.0);
-			weighted_event_count_after_knot = 0;
+			last_event_time = start_time;
+			state = 0;
+			excitation = Eigen::VectorXd::Constant(num_event_types, 0.0);
+			compensator = Eigen::VectorXd::Constant(num_event_types, 0.0);
+			weighted_log_intensity_sum = 0;
+			exposure = Eigen::MatrixXd::Constant(block_size, num_states, 0.0);
+			weighted_score_sums = Eigen::MatrixXd::Constant(block_size, num_states * num_event_types, 0.0);
+			hessian_blocks.assign(num_states * num_event_types, Eigen::MatrixXd::Constant(block_size, block_size, 0.0));
 		};
+
 	private:
-		Eigen::VectorXd coef;
-		REAL knot;
-		Eigen::VectorXd weighted_event_counts;
-		REAL weighted_max_reciprocal_sum_after_knot;
-		REAL weighted_maxsquared_reciprocal_sum_after_knot;
+		//The session tail after the last event is still exposure in the final state.
+		Eigen::MatrixXd get_total_exposure() {
+			Eigen::MatrixXd total_exposure = exposure;
+			REAL tail = end_time - last_event_time;
+			if (tail > 0) {
+				total_exposure(0, state) += tail;
+				total_exposure.col(state).tail(num_event_types) += decayed_integral(tail);
+			}
+			return total_exposure;
+		}
+
+		//Integral of the excitation vector over the next timediff seconds, assuming no events arrive.
+		Eigen::VectorXd decayed_integral(REAL timediff) {
+			return excitation * ((1 - std::exp(-beta * timediff)) / beta);
+		}
+
+		//Integral of every type's intensity over the next timediff seconds in the current state.
+		Eigen::VectorXd interval_compensators(REAL timediff) {
+			Eigen::VectorXd features(block_size);
+			features[0] = timediff;
+			features.tail(num_event_types) = decayed_integral(timediff);
+			return coef.middleCols(state * num_event_types, num_event_types).transpose() * features;
+		}
+
+		BookStateDiscretiser discretiser;
+		REAL beta, last_event_time, weighted_log_intensity_sum;
+		int num_states, block_size, state;
+		Eigen::MatrixXd coef;
+		Eigen::VectorXd excitation, compensator;
+		Eigen::MatrixXd exposure, weighted_score_sums;
+		std::vector<Eigen::MatrixXd> hessian_blocks;
 };
 
 /*
@@ -334,3 +530,5 @@ class ExpHawkesKernel {
 		}
 };
 */
+
+#endif //KERNEL_H
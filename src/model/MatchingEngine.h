@@ -0,0 +1,207 @@
+#ifndef MATCHINGENGINE_H
+#define MATCHINGENGINE_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "Types.h"
+#include "Book.h"
+
+struct MatchingOptions {
+	//Seconds from submit() or cancel() until the exchange sees the request.
+	REAL order_latency = 0;
+	REAL cancel_latency = 0;
+	//Most agent orders alive at once; the engine never allocates beyond this.
+	int max_orders = 64;
+	//Expected number of fills between calls to clear_fills(), reserved up front.
+	int fill_capacity = 1024;
+};
+
+struct AgentOrder {
+	long id;
+	BookSide side;
+	long tick;
+	double remaining;
+	//Historical size resting ahead of this order at its level.
+	double queue_ahead;
+	//Size traded at this level that the feed will still report as cancels, which must not advance the queue twice.
+	double traded_pending;
+	REAL active_time, cancel_time;
+	bool active;
+};
+
+struct AgentFill {
+	long id;
+	REAL time;
+	long tick;
+	double size;
+	//True when the order took liquidity on arrival rather than being filled while resting.
+	bool aggressive;
+};
+
+/*
+ * Price-time priority matching of simulated agent orders against a replayed L2Book.
+ * Agent orders never enter the historical book. A resting order joins the back of its level with the level's size as
+ * queue_ahead; trades at the level consume queue_ahead before filling the order, trades through its price fill it
+ * outright, and cancels at the level are assumed to be spread evenly through the queue, so they remove the share of
+ * themselves that is ahead. Adds join behind, and agent orders at the same level queue in submission order. A
+ * marketable order walks the opposite side from the touch up to its limit when it arrives, without depleting the
+ * historical levels (no market impact), and rests whatever is left.
+ * Call on_event() with each event before the book applies it (ReplayEngine::next(observer) does this), so the
+ * book shows the state the event arrived to. Orders and fills live in buffers sized from MatchingOptions, so the
+ * per-message path does not allocate.
+ */
+class MatchingEngine {
+	public:
+		MatchingEngine(const L2Book& book, MatchingOptions options=MatchingOptions()) : book(book), options(options) {
+			orders.reserve(options.max_orders);
+			fills.reserve(options.fill_capacity);
+		}
+
+		//Queues a limit order to reach the exchange after the order latency; returns its id, or -1 if max_orders are alive.
+		long submit(BookSide side, double price, double size, REAL time) {
+			if ((int)orders.size() >= options.max_orders) {
+				return -1;
+			}
+			orders.push_back({next_id, side, book.to_tick(price), size, 0, 0, time + options.order_latency, INFINITY, false});
+			return next_id++;
+		}
+
+		//Requests a cancel that takes effect after the cancel latency; the order can still fill until then.
+		void cancel(long id, REAL time) {
+			for (AgentOrder& order : orders) {
+				if (order.id == id) {
+					order.cancel_time = std::min(order.cancel_time, time + options.cancel_latency);
+				}
+			}
+		}
+
+		//Activates and expires orders up to time, using the book as it is now.
+		void advance(REAL time) {
+			for (AgentOrder& order : orders) {
+				if (order.cancel_time <= time) {
+					order.remaining = 0;
+				} else if (!order.active && order.active_time <= time) {
+					arrive(order);
+				}
+			}
+			retire();
+		}
+
+		void on_event(const Event& event) {
+			advance(event.time);
+			if (orders.empty() || event.marks.size() <= ORDER_PRICE || std::isnan(event.marks[ORDER_PRICE])) {
+				return;
+			}
+			BookSide side = event_side(event.event_type);
+			long tick = book.to_tick(event.marks[ORDER_PRICE]);
+			double size = event.marks[ORDER_SIZE];
+			switch (event_action(event.event_type)) {
+				case TRADE:
+					//The side of a trade is the aggressor's, so it matches resting orders on the other side.
+					trade(side == BID ? ASK : BID, tick, size, event.time);
+					break;
+				case CANCEL:
+					cancelled(side, tick, size);
+					break;
+				default:
+					break;
+			}
+			retire();
+		}
+
+		const std::vector<AgentFill>& get_fills() const {
+			return fills;
+		}
+
+		void clear_fills() {
+			fills.clear();
+		}
+
+		//Live orders (queued, resting or awaiting a cancel) in submission order.
+		const std::vector<AgentOrder>& get_orders() const {
+			return orders;
+		}
+
+	private:
+		//An order reaching the exchange: take what it crosses, then rest the remainder at the back of its level.
+		void arrive(AgentOrder& order) {
+			order.active = true;
+			BookSide other = order.side == BID ? ASK : BID;
+			if (!book.empty(other)) {
+				int step = order.side == BID ? 1 : -1;
+				for (long tick = book.best(other); order.remaining > 0 && (order.side == BID ? tick <= order.tick : tick >= order.tick); tick += step) {
+					double available = book.size_at(other, tick);
+					if (available > 0) {
+						fill(order, tick, std::min(available, order.remaining), order.active_time, true);
+					}
+				}
+			}
+			order.queue_ahead = book.size_at(order.side, order.tick);
+		}
+
+		//Hands out size traded against the resting side at tick to agent orders in price-time priority.
+		void trade(BookSide resting_side, long tick, double size, REAL time) {
+			//Orders priced through the trade would have been hit first.
+			for (AgentOrder& order : orders) {
+				if (order.active && order.side == resting_side && order.remaining > 0 && (resting_side == BID ? order.tick > tick : order.tick < tick)) {
+					double filled = std::min(size, order.remaining);
+					fill(order, order.tick, filled, time, false);
+					size -= filled;
+				}
+			}
+			//At the level, each order in submission order waits for the historical size ahead of it and then fills, so
+			//earlier agent orders are ahead of later ones and the print is handed out once in total. Historical size
+			//taken before an earlier order was ahead of every later order too.
+			double historical_taken = 0;
+			for (AgentOrder& order : orders) {
+				if (order.active && order.side == resting_side && order.tick == tick && order.remaining > 0) {
+					double shared = std::min(order.queue_ahead, historical_taken);
+					double ahead = std::min(size, order.queue_ahead - shared);
+					order.queue_ahead -= shared + ahead;
+					order.traded_pending += shared + ahead;
+					size -= ahead;
+					historical_taken += ahead;
+					double filled = std::min(size, order.remaining);
+					if (filled > 0) {
+						fill(order, tick, filled, time, false);
+						size -= filled;
+					}
+				}
+			}
+		}
+
+		void cancelled(BookSide side, long tick, double size) {
+			double level = book.size_at(side, tick);
+			for (AgentOrder& order : orders) {
+				if (order.active && order.side == side && order.tick == tick) {
+					double reported = std::min(size, order.traded_pending);
+					order.traded_pending -= reported;
+					if (level > 0 && size > reported) {
+						order.queue_ahead = std::max(0.0, order.queue_ahead - (size - reported) * order.queue_ahead / level);
+					}
+				}
+			}
+		}
+
+		void fill(AgentOrder& order, long tick, double size, REAL time, bool aggressive) {
+			order.remaining -= size;
+			fills.push_back({order.id, time, tick, size, aggressive});
+		}
+
+		//Drops finished orders in place, keeping submission order.
+		void retire() {
+			orders.erase(std::remove_if(orders.begin(), orders.end(), [](const AgentOrder& order) {
+				return order.remaining <= 0;
+			}), orders.end());
+		}
+
+		const L2Book& book;
+		MatchingOptions options;
+		std::vector<AgentOrder> orders;
+		std::vector<AgentFill> fills;
+		long next_id = 0;
+};
+
+#endif //MATCHINGENGINE_H
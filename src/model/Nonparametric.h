@@ -0,0 +1,293 @@
+#ifndef NONPARAMETRIC_H
+#define NONPARAMETRIC_H
+
+#include <string>
+#include <vector>
+#include <complex>
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <cmath>
+
+#include <Eigen/Dense>
+#include <unsupported/Eigen/FFT>
+
+#include "Types.h"
+#include "Binning.h"
+
+/*
+ * Raw second-order statistics of binned counts x_i(t): per type the total count, and per ordered pair the lagged
+ * products sum_t x_i(t) x_k(t + n) for |n| <= max_lag, summed over sessions with no pair spanning two sessions.
+ */
+struct BinnedCorrelations {
+	int num_types, max_lag;
+	REAL bin_width;
+	double total_time = 0;
+	std::vector<double> counts;
+	std::vector<double> products;
+
+	BinnedCorrelations(int num_types, int max_lag, REAL bin_width) : num_types(num_types), max_lag(max_lag), bin_width(bin_width), counts(num_types, 0), products((size_t)num_types * num_types * (2 * max_lag + 1), 0) {}
+
+	double& product(int i, int k, int lag) {
+		return products[((size_t)i * num_types + k) * (2 * max_lag + 1) + lag + max_lag];
+	}
+
+	double product(int i, int k, int lag) const {
+		return products[((size_t)i * num_types + k) * (2 * max_lag + 1) + lag + max_lag];
+	}
+
+	void merge(const BinnedCorrelations& other) {
+		total_time += other.total_time;
+		for (int i = 0; i < num_types; i++) {
+			counts[i] += other.counts[i];
+		}
+		for (size_t i = 0; i < products.size(); i++) {
+			products[i] += other.products[i];
+		}
+	}
+
+	//Mean rate of each type, Lambda_i.
+	Eigen::VectorXd intensity() const {
+		Eigen::VectorXd rates(num_types);
+		for (int i = 0; i < num_types; i++) {
+			rates[i] = counts[i] / std::max<double>(total_time, 1e-300);
+		}
+		return rates;
+	}
+
+	/*
+	 * g_ik(lag) = E[dN_k(t + lag) | dN_i(t)] / dt - Lambda_k, the conditional excess rate of k a given number of bins
+	 * after an i event, with each event's pairing with itself removed at lag 0. Pairs near the end of a session are
+	 * cut off, which biases it by about max_lag over the bins per session.
+	 */
+	double conditional(int i, int k, int lag) const {
+		if (counts[i] == 0) {
+			return 0;
+		}
+		double pairs = product(i, k, lag) - (i == k && lag == 0 ? counts[i] : 0);
+		return pairs / (counts[i] * (double)bin_width) - counts[k] / std::max<double>(total_time, 1e-300);
+	}
+};
+
+/*
+ * Accumulates BinnedCorrelations for the given count columns of a binned matrix (see run_event_binning), over every
+ * session in its .meta file. Sessions are cut into chunks of bins and the chunks, from all sessions, are shared out
+ * to num_threads threads, each keeping its own sums that are merged at the end. Within a chunk each type's counts and
+ * each type's counts widened by max_lag bins on both sides are transformed once, and then every pair's lagged
+ * products come from one inverse FFT of their spectra, all d^2 pairs reusing the same 2d forward transforms. Chunks
+ * are a few times longer than the lag window, so the transforms stay small and cache-resident however long a day is.
+ */
+BinnedCorrelations binned_correlations(const std::string& filename, const std::vector<int>& columns, REAL bin_width, int max_lag, int num_threads=std::thread::hardware_concurrency()) {
+	int d = columns.size();
+	BinnedCorrelations total(d, max_lag, bin_width);
+	NpyMatrixView matrix(filename);
+	std::vector<BinnedSession> sessions = read_binning_sessions(filename);
+
+	size_t transform_size = 1 << 12;
+	while (transform_size < (size_t)8 * (2 * max_lag + 1)) {
+		transform_size *= 2;
+	}
+	size_t chunk_size = transform_size - 2 * max_lag;
+	struct Chunk {
+		size_t session, start;
+	};
+	std::vector<Chunk> chunks;
+	for (size_t s = 0; s < sessions.size(); s++) {
+		if (sessions[s].first_row + sessions[s].num_bins > matrix.rows) {
+			std::cerr << sessions[s].path << " lies outside " << filename << std::endl;
+			continue;
+		}
+		for (size_t start = 0; start < sessions[s].num_bins; start += chunk_size) {
+			chunks.push_back({s, start});
+		}
+		total.total_time += sessions[s].num_bins * (double)bin_width;
+	}
+
+	std::mutex total_mutex;
+	std::atomic<size_t> next_chunk(0);
+	auto worker = [&]() {
+		BinnedCorrelations local(d, max_lag, bin_width);
+		Eigen::FFT<double> fft;
+		fft.SetFlag(Eigen::FFT<double>::HalfSpectrum);
+		std::vector<double> series(transform_size), lagged(transform_size);
+		std::vector<std::vector<std::complex<double>>> centre_spectra(d), window_spectra(d);
+		std::vector<std::complex<double>> product;
+		for (size_t c = next_chunk++; c < chunks.size(); c = next_chunk++) {
+			const BinnedSession& session = sessions[chunks[c].session];
+			size_t start = chunks[c].start;
+			size_t length = std::min(chunk_size, session.num_bins - start);
+			//The chunk's bins and the window [start - max_lag, start + length + max_lag) around them, clipped to the session.
+			size_t window_start = start >= (size_t)max_lag ? start - max_lag : 0;
+			size_t window_end = std::min(session.num_bins, start + length + max_lag);
+			auto window = matrix.block(session.first_row + window_start, window_end - window_start);
+			size_t offset = start - window_start;
+			size_t shift = max_lag - offset;
+
+			for (int i = 0; i < d; i++) {
+				std::fill(series.begin(), series.end(), 0.0);
+				std::fill(lagged.begin(), lagged.end(), 0.0);
+				for (size_t t = 0; t < length; t++) {
+					series[t] = window(offset + t, columns[i]);
+					local.counts[i] += series[t];
+				}
+				for (Eigen::Index t = 0; t < window.rows(); t++) {
+					lagged[shift + t] = window(t, columns[i]);
+				}
+				fft.fwd(centre_spectra[i], series);
+				fft.fwd(window_spectra[i], lagged);
+			}
+
+			//Correlating the chunk with the window puts lag n at index n + max_lag, clear of any wrap-around.
+			for (int i = 0; i < d; i++) {
+				for (int k = 0; k < d; k++) {
+					product.resize(centre_spectra[i].size());
+					for (size_t f = 0; f < product.size(); f++) {
+						product[f] = std::conj(centre_spectra[i][f]) * window_spectra[k][f];
+					}
+					fft.inv(lagged, product, transform_size);
+					for (int lag = -max_lag; lag <= max_lag; lag++) {
+						local.product(i, k, lag) += std::round(lagged[lag + max_lag]);
+					}
+				}
+			}
+		}
+		std::lock_guard<std::mutex> lock(total_mutex);
+		total.merge(local);
+	};
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < std::max(num_threads, 1); t++) {
+		threads.emplace_back(worker);
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	return total;
+}
+
+/*
+ * Nonparametric Hawkes kernels phi_jk (the effect of a type k event on the rate of type j), sampled at lags of
+ * 1..num_lags bins, as solved for by solve_wiener_hopf.
+ */
+struct NonparametricKernels {
+	int num_types, num_lags;
+	REAL bin_width;
+	Eigen::VectorXd intensity;
+	//Row k * num_lags + m - 1, column j holds phi_jk(m * bin_width).
+	Eigen::MatrixXd values;
+
+	Eigen::VectorXd lags() const {
+		return Eigen::VectorXd::LinSpaced(num_lags, 1, num_lags) * (double)bin_width;
+	}
+
+	Eigen::VectorXd curve(int target, int source) const {
+		return values.block(source * num_lags, target, num_lags, 1);
+	}
+
+	//Branching ratios ||phi_jk||, the expected number of j events triggered directly by one k event.
+	Eigen::MatrixXd norms() const {
+		Eigen::MatrixXd result(num_types, num_types);
+		for (int j = 0; j < num_types; j++) {
+			for (int k = 0; k < num_types; k++) {
+				result(j, k) = curve(j, k).sum() * (double)bin_width;
+			}
+		}
+		return result;
+	}
+
+	//Background rates mu = (I - ||phi||) Lambda.
+	Eigen::VectorXd background() const {
+		return intensity - norms() * intensity;
+	}
+
+	/*
+	 * Amplitudes a_r of phi_jk(t) ~ sum_r a_r exp(-decays_r t) by least squares over the sampled lags, for a
+	 * sum-of-exponentials kernel with fixed decays.
+	 */
+	Eigen::VectorXd fit_exponentials(int target, int source, const Eigen::VectorXd& decays) const {
+		Eigen::MatrixXd basis = (-lags() * decays.transpose()).array().exp();
+		return basis.colPivHouseholderQr().solve(curve(target, source));
+	}
+
+	/*
+	 * (alpha, beta) of phi_jk(t) = alpha exp(-beta t) with the same norm alpha / beta and mean lag 1 / beta as the
+	 * estimate. Kernels with no positive mass get alpha = 0 and the decay of the lag window.
+	 */
+	std::pair<double, double> fit_exponential(int target, int source) const {
+		Eigen::VectorXd phi = curve(target, source);
+		double norm = phi.sum() * (double)bin_width;
+		double first_moment = phi.dot(lags()) * (double)bin_width;
+		if (!(norm > 0 && first_moment > 0)) {
+			return {0.0, 1.0 / (num_lags * (double)bin_width)};
+		}
+		double beta = norm / first_moment;
+		return {norm * beta, beta};
+	}
+
+	/*
+	 * Parameters for AutodiffExpHawkesKernel<num_types>::set_params, from fit_exponential for every pair and the
+	 * background rates as nu (which is right for a flat background profile). Negative fitted excitations and
+	 * backgrounds are clipped to small positive values, since that kernel keeps its parameters positive.
+	 */
+	Eigen::VectorXd exp_hawkes_params() const {
+		int block_size = 1 + 2 * num_types;
+		Eigen::MatrixXd coef(block_size, num_types);
+		Eigen::VectorXd mu = background();
+		for (int j = 0; j < num_types; j++) {
+			coef(0, j) = std::max(mu[j], 1e-3 * intensity[j] + 1e-12);
+			for (int k = 0; k < num_types; k++) {
+				auto [alpha, beta] = fit_exponential(j, k);
+				coef(1 + k, j) = std::max(alpha, 1e-12);
+				coef(1 + num_types + k, j) = beta;
+			}
+		}
+		return Eigen::Map<Eigen::VectorXd>(coef.data(), coef.size());
+	}
+};
+
+/*
+ * Bacry and Muzy's nonparametric estimate: for t > 0 the conditional excess rates satisfy the Wiener-Hopf system
+ *	g_ij(t) = phi_ji(t) + sum_k int_0^inf phi_jk(s) g_ik(t - s) ds,
+ * which on the bin grid (t, s = 1..num_lags bins, right-point quadrature) is (I + h G) Phi = B, with
+ * G[(i, n), (k, m)] = g_ik((n - m) h), B[(i, n), j] = g_ij(n h) and Phi[(k, m), j] = phi_jk(m h). G is the same for
+ * every target j, so one LU factorisation of the (d num_lags)^2 block Toeplitz matrix solves all d columns.
+ * num_lags must not exceed the max_lag the correlations were accumulated with.
+ */
+NonparametricKernels solve_wiener_hopf(const BinnedCorrelations& correlations, int num_lags) {
+	int d = correlations.num_types;
+	num_lags = std::min(num_lags, correlations.max_lag);
+	REAL h = correlations.bin_width;
+	int size = d * num_lags;
+	Eigen::MatrixXd system(size, size), targets(size, d);
+	for (int i = 0; i < d; i++) {
+		for (int n = 1; n <= num_lags; n++) {
+			for (int k = 0; k < d; k++) {
+				for (int m = 1; m <= num_lags; m++) {
+					system(i * num_lags + n - 1, k * num_lags + m - 1) = (double)h * correlations.conditional(i, k, n - m) + (i == k && n == m);
+				}
+			}
+			for (int j = 0; j < d; j++) {
+				targets(i * num_lags + n - 1, j) = correlations.conditional(i, j, n);
+			}
+		}
+	}
+	return NonparametricKernels{d, num_lags, h, correlations.intensity(), system.partialPivLu().solve(targets)};
+}
+
+//Kernels between the event types of one instrument of a matrix written by run_event_binning with this layout.
+NonparametricKernels estimate_hawkes_kernels(const std::string& filename, const BinningLayout& layout, const std::string& instrument, int num_lags, int num_threads=std::thread::hardware_concurrency()) {
+	int index = layout.instrument_index(instrument);
+	if (index < 0) {
+		std::cerr << instrument << " is not in the binning layout" << std::endl;
+		index = 0;
+	}
+	std::vector<int> columns;
+	for (int type = 0; type < layout.num_types; type++) {
+		columns.push_back(layout.count_column(index, type));
+	}
+	return solve_wiener_hopf(binned_correlations(filename, columns, layout.bin_width, num_lags, num_threads), num_lags);
+}
+
+#endif //NONPARAMETRIC_H
@@ -0,0 +1,132 @@
+#ifndef ONLINE_H
+#define ONLINE_H
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+#include "Kernel.h"
+
+//Log2-bucketed histogram of per-event latencies in nanoseconds, with constant memory.
+class LatencyHistogram {
+	public:
+		LatencyHistogram() : buckets(Eigen::VectorXd::Constant(64, 0.0)), count(0), total(0), max(0) {}
+
+		void record(double nanoseconds) {
+			int bucket = nanoseconds < 1 ? 0 : std::min(63, 1 + (int)std::log2(nanoseconds));
+			buckets[bucket] += 1;
+			count++;
+			total += nanoseconds;
+			max = std::max(max, nanoseconds);
+		}
+
+		//Upper edge of the bucket containing the q-th quantile.
+		double quantile(double q) const {
+			double cumulative = 0;
+			for (int b = 0; b < buckets.size(); b++) {
+				cumulative += buckets[b];
+				if (cumulative >= q * count) {
+					return std::ldexp(1.0, b);
+				}
+			}
+			return max;
+		}
+
+		double mean() const {
+			return count > 0 ? total / count : 0;
+		}
+
+		void print(std::ostream& os) const {
+			os << "n=" << count << " mean=" << mean() << "ns p50<=" << quantile(0.5) << "ns p99<=" << quantile(0.99) << "ns p99.99<=" << quantile(0.9999) << "ns max=" << max << "ns" << std::endl;
+		}
+
+		Eigen::VectorXd buckets;
+		long count;
+		double total, max;
+};
+
+/*
+ * Recursive maximum likelihood on top of any Kernel.
+ * The kernel keeps accumulating its usual sufficient statistics; every step_interval events they are discounted by
+ * 2^(-elapsed/half_life) and a damped natural-gradient step (the forgotten observed information standing in for the
+ * Fisher metric) moves the parameters, capped relative to their size. Per-event work is one kernel update, and the
+ * step cost depends only on the number of parameters, so latency stays bounded however long the session runs.
+ * Kernels whose statistics depend on the parameters keep reporting the score at the points it was evaluated, so the
+ * estimator adds H step to it after every step and discounts that correction along with the statistics.
+ */
+class OnlineEstimator {
+	public:
+		OnlineEstimator(Kernel& kernel, REAL half_life, int step_interval=100, REAL learning_rate=1.0, REAL max_relative_step=0.5, REAL regularisation=1e-6) : kernel(kernel), half_life(half_life), step_interval(step_interval), learning_rate(learning_rate), max_relative_step(max_relative_step), regularisation(regularisation), events_since_step(0), last_step_time(kernel.current_time) {}
+
+		void observe(const Event& event) {
+			auto start = std::chrono::steady_clock::now();
+
+			kernel.update(event);
+			events_since_step++;
+			if (events_since_step >= step_interval) {
+				step(event.time);
+			}
+
+			auto end = std::chrono::steady_clock::now();
+			latency.record(std::chrono::duration<double, std::nano>(end - start).count());
+		}
+
+		void step(REAL time) {
+			double factor = std::exp2(-(time - last_step_time) / half_life);
+			kernel.discount(factor);
+			last_step_time = time;
+			events_since_step = 0;
+
+			kernel.end_time = time;
+			auto [hess, grad] = kernel.get_structured_hessian_and_gradient();
+			if (carried_gradient.size() == grad.size()) {
+				carried_gradient *= factor;
+				grad += carried_gradient;
+			} else {
+				carried_gradient = Eigen::VectorXd::Zero(grad.size());
+			}
+			hess.add_to_diagonal(-regularisation);
+			Eigen::VectorXd step = -hess.solve(grad) * (double)learning_rate;
+
+			//Thin statistics early in a regime can ask for huge steps, so no parameter moves by more than max_relative_step of itself.
+			Eigen::ArrayXd limit = (double)max_relative_step * (kernel.get_params().array().abs() + 1e-3);
+			double scale = (limit / step.array().abs()).minCoeff();
+			if (scale < 1) {
+				step *= scale;
+			}
+			if (step.allFinite()) {
+				kernel.parameter_step(step);
+				//Statistics already gathered stay evaluated at the old parameters, so the score they report is moved to
+				//the new ones to first order (H step); otherwise the next step would apply the same gradient again.
+				if (kernel.statistics_depend_on_params()) {
+					carried_gradient += hess.multiply(step) + (double)regularisation * step;
+				}
+			}
+		}
+
+		Eigen::VectorXd get_intensities() {
+			return kernel.get_intensities();
+		}
+
+		Eigen::VectorXd get_params() {
+			return kernel.get_params();
+		}
+
+		LatencyHistogram latency;
+
+	private:
+		Kernel& kernel;
+		REAL half_life;
+		int step_interval;
+		REAL learning_rate, max_relative_step, regularisation;
+		int events_since_step;
+		REAL last_step_time;
+		//First-order change in the score of the discounted past since it was evaluated, for kernels that do not re-evaluate it.
+		Eigen::VectorXd carried_gradient;
+};
+
+#endif //ONLINE_H
@@ -0,0 +1,325 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <functional>
+#include <deque>
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+#include <climits>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+#include "Hessian.h"
+#include "Kernel.h"
+
+enum OptimizerMethod {
+	DAMPED_NEWTON,
+	TRUST_REGION,
+	LBFGS
+};
+
+struct OptimizerOptions {
+	OptimizerMethod method = DAMPED_NEWTON;
+	int max_passes = 50;
+	//Stop once the projected gradient is this small, or once an accepted step changes the log-likelihood or the parameters by less than relative_tolerance.
+	REAL gradient_tolerance = 1e-6;
+	REAL relative_tolerance = 1e-10;
+	//A starting point on or outside a bound is moved this fraction of the box width (or of its own size) inside.
+	REAL interior_margin = 0.01;
+	REAL armijo = 1e-4;
+	//Backtracking on a Newton or L-BFGS direction gives up after this many halvings and falls back to the gradient.
+	int max_halvings = 6;
+	REAL initial_trust_radius = 1.0;
+	int lbfgs_memory = 10;
+	bool verbose = false;
+};
+
+struct OptimizerResult {
+	Eigen::VectorXd params;
+	REAL log_likelihood;
+	int passes, iterations;
+	bool converged;
+};
+
+/*
+ * Maximises a kernel's log-likelihood through get_params/set_params.
+ * run_pass(kernel) must push one realisation through a freshly reset kernel (setting start_time/end_time as needed),
+ * and is the only expensive operation: every evaluation is one pass giving the log-likelihood, gradient and Hessian
+ * together, so a trial point that gets accepted is already the next iterate and costs nothing further. Kernels whose
+ * statistics do not depend on their parameters are only passed over once. If the last pass was a rejected trial,
+ * maximise ends with one more at the accepted point, so the kernel is left loaded at the parameters it returns.
+ * Bounds come from the kernel. Trial points are projected onto the box, and parameters pressed against a bound with
+ * the gradient pointing out of it are held fixed, so the search continues in the remaining free directions.
+ */
+class Optimizer {
+	public:
+		Optimizer(Kernel& kernel, std::function<void(Kernel&)> run_pass, OptimizerOptions options=OptimizerOptions()) : kernel(kernel), run_pass(run_pass), options(options), current(StructuredHessian::dense(Eigen::MatrixXd())) {}
+
+		OptimizerResult maximise() {
+			passes = 0;
+			iterations = 0;
+			lower = kernel.get_lower_bounds();
+			upper = kernel.get_upper_bounds();
+			trust_radius = options.initial_trust_radius;
+			steps.clear();
+			gradient_changes.clear();
+
+			//Starting on or outside a bound would leave no room to move inwards from it.
+			Eigen::VectorXd start = kernel.get_params();
+			REAL margin = options.interior_margin;
+			for (int i = 0; i < start.size(); i++) {
+				REAL width = lower[i] > -INFINITY && upper[i] < INFINITY ? upper[i] - lower[i] : 1 + std::abs(start[i]);
+				if (start[i] <= lower[i]) {
+					start[i] = lower[i] + margin * width;
+				} else if (start[i] >= upper[i]) {
+					start[i] = upper[i] - margin * width;
+				}
+			}
+			current = evaluate(start);
+
+			bool converged = false;
+			while (passes < options.max_passes && !converged) {
+				if (projected_gradient(current).lpNorm<Eigen::Infinity>() <= options.gradient_tolerance) {
+					converged = true;
+					break;
+				}
+				Evaluation previous = current;
+				bool moved = false;
+				switch (options.method) {
+					case DAMPED_NEWTON:
+						moved = newton_iteration();
+						break;
+					case TRUST_REGION:
+						moved = trust_region_iteration();
+						break;
+					case LBFGS:
+						moved = lbfgs_iteration();
+						break;
+				}
+				iterations++;
+				if (options.verbose) {
+					std::cout << "iteration " << iterations << " passes " << passes << " log-likelihood " << current.log_likelihood << std::endl;
+				}
+				if (!moved) {
+					//A rejected trust-region step only shrinks the radius; otherwise no ascent step exists at this tolerance.
+					if (options.method == TRUST_REGION && trust_radius > options.relative_tolerance * (1 + current.params.norm())) {
+						continue;
+					}
+					converged = passes < options.max_passes;
+					break;
+				}
+				REAL change = current.log_likelihood - previous.log_likelihood;
+				REAL step = (current.params - previous.params).norm();
+				converged = change <= options.relative_tolerance * (1 + std::abs(current.log_likelihood)) || step <= options.relative_tolerance * (1 + current.params.norm());
+			}
+
+			//The last pass may have been a rejected trial point, so reload the accepted one: afterwards the kernel's
+			//statistics, Hessian and log-likelihood (as make_fit_record reads them) belong to the returned parameters.
+			kernel.set_params(current.params);
+			if (loaded_params != current.params && kernel.statistics_depend_on_params()) {
+				kernel.reset();
+				run_pass(kernel);
+				passes++;
+				loaded_params = current.params;
+			}
+			return {current.params, current.log_likelihood, passes, iterations, converged};
+		}
+
+	private:
+		struct Evaluation {
+			Eigen::VectorXd params;
+			REAL log_likelihood;
+			Eigen::VectorXd gradient;
+			StructuredHessian hessian;
+
+			Evaluation(StructuredHessian hessian) : log_likelihood(-INFINITY), hessian(hessian) {}
+
+			bool valid() const {
+				return std::isfinite((double)log_likelihood) && gradient.allFinite();
+			}
+		};
+
+		Evaluation evaluate(const Eigen::VectorXd& params) {
+			kernel.set_params(params);
+			//Kernels with parameter-free statistics only need the data once per maximise().
+			if (passes == 0 || kernel.statistics_depend_on_params()) {
+				kernel.reset();
+				run_pass(kernel);
+			}
+			passes++;
+			loaded_params = params;
+
+			auto [hessian, gradient] = kernel.get_structured_hessian_and_gradient();
+			Evaluation evaluation(hessian);
+			evaluation.params = params;
+			evaluation.gradient = gradient;
+			evaluation.log_likelihood = kernel.get_log_likelihood();
+			return evaluation;
+		}
+
+		//Parameters on a bound whose gradient points out of the box cannot move.
+		Eigen::ArrayXd free_mask(const Evaluation& evaluation) {
+			Eigen::ArrayXd x = evaluation.params.array();
+			Eigen::ArrayXd g = evaluation.gradient.array();
+			return ((x <= lower.array() && g < 0) || (x >= upper.array() && g > 0)).select(0.0, Eigen::ArrayXd::Ones(x.size()));
+		}
+
+		Eigen::VectorXd projected_gradient(const Evaluation& evaluation) {
+			return (evaluation.gradient.array() * free_mask(evaluation)).matrix();
+		}
+
+		Eigen::VectorXd project(const Eigen::VectorXd& x) {
+			return x.cwiseMax(lower).cwiseMin(upper);
+		}
+
+		//Backtracking Armijo search along the projected path; every trial is one pass.
+		bool line_search(Eigen::VectorXd direction, int max_halvings=INT_MAX) {
+			direction = (direction.array() * free_mask(current)).matrix();
+			REAL step = 1;
+			for (int halvings = 0; halvings <= max_halvings && passes < options.max_passes && step * direction.norm() > options.relative_tolerance * (1 + current.params.norm()); halvings++) {
+				Eigen::VectorXd target = project(current.params + step * direction);
+				Evaluation trial = evaluate(target);
+				if (trial.valid() && trial.log_likelihood >= current.log_likelihood + options.armijo * current.gradient.dot(target - current.params)) {
+					accept(trial);
+					return true;
+				}
+				step *= 0.5;
+			}
+			return false;
+		}
+
+		void accept(const Evaluation& trial) {
+			if (options.method == LBFGS) {
+				Eigen::VectorXd s = trial.params - current.params;
+				//Curvature pairs for the minimisation of -log-likelihood.
+				Eigen::VectorXd y = current.gradient - trial.gradient;
+				if (s.dot(y) > 1e-12 * s.norm() * y.norm()) {
+					steps.push_back(s);
+					gradient_changes.push_back(y);
+					if ((int)steps.size() > options.lbfgs_memory) {
+						steps.pop_front();
+						gradient_changes.pop_front();
+					}
+				}
+			}
+			current = trial;
+		}
+
+		Eigen::VectorXd gradient_direction() {
+			Eigen::VectorXd g = projected_gradient(current);
+			return g * (double)(trust_radius / std::max((REAL)g.norm(), (REAL)1e-300));
+		}
+
+		//Away from the optimum the Hessian need not be negative definite; shift it by a growing multiple of the identity
+		//(Levenberg-Marquardt) until the Newton step is an ascent direction. Returns a zero vector if none is found.
+		Eigen::VectorXd newton_direction() {
+			const Eigen::VectorXd& g = current.gradient;
+			Eigen::VectorXd direction = -current.hessian.solve(g);
+			REAL shift = 1e-6 * std::max((REAL)current.hessian.diagonal().cwiseAbs().maxCoeff(), (REAL)1);
+			for (int attempt = 0; attempt < 20 && !(direction.allFinite() && g.dot(direction) > 0); attempt++) {
+				StructuredHessian shifted = current.hessian;
+				shifted.add_to_diagonal(-shift);
+				direction = -shifted.solve(g);
+				shift *= 10;
+			}
+			if (!direction.allFinite() || g.dot(direction) <= 0) {
+				return Eigen::VectorXd::Zero(g.size());
+			}
+			return direction;
+		}
+
+		bool newton_iteration() {
+			Eigen::VectorXd direction = newton_direction();
+			if (direction.isZero()) {
+				return line_search(gradient_direction());
+			}
+			//Nearly flat directions (e.g. a decay rate whose excitation has gone to zero) give huge steps that never pass.
+			return line_search(direction, options.max_halvings) || line_search(gradient_direction());
+		}
+
+		bool lbfgs_iteration() {
+			if (steps.empty()) {
+				return line_search(gradient_direction());
+			}
+			//Two-loop recursion on -log-likelihood, so q starts as its gradient.
+			Eigen::VectorXd q = -current.gradient;
+			int m = steps.size();
+			std::vector<double> alpha(m), rho(m);
+			for (int k = m - 1; k >= 0; k--) {
+				rho[k] = 1.0 / gradient_changes[k].dot(steps[k]);
+				alpha[k] = rho[k] * steps[k].dot(q);
+				q -= alpha[k] * gradient_changes[k];
+			}
+			q *= steps.back().dot(gradient_changes.back()) / gradient_changes.back().squaredNorm();
+			for (int k = 0; k < m; k++) {
+				double beta = rho[k] * gradient_changes[k].dot(q);
+				q += (alpha[k] - beta) * steps[k];
+			}
+			Eigen::VectorXd direction = -q;
+			if (!direction.allFinite() || current.gradient.dot(direction) <= 0) {
+				direction = gradient_direction();
+			}
+			if (line_search(direction, options.max_halvings)) {
+				return true;
+			}
+			//Stale curvature pairs can point along a ridge; restart the memory from steepest ascent.
+			steps.clear();
+			gradient_changes.clear();
+			return line_search(gradient_direction());
+		}
+
+		//Dogleg step on the quadratic model g.p + p.H.p/2 within trust_radius.
+		bool trust_region_iteration() {
+			const Eigen::VectorXd& g = current.gradient;
+			const StructuredHessian& H = current.hessian;
+
+			REAL curvature = g.dot(H.multiply(g));
+			REAL cauchy_length = curvature < 0 ? g.squaredNorm() / -curvature : INFINITY;
+			Eigen::VectorXd cauchy = g * (double)std::min(cauchy_length, trust_radius / g.norm());
+
+			Eigen::VectorXd step;
+			Eigen::VectorXd newton = newton_direction();
+			bool newton_valid = !newton.isZero() && newton.dot(H.multiply(newton)) < 0;
+			if (newton_valid && newton.norm() <= trust_radius) {
+				step = newton;
+			} else if (!newton_valid || cauchy.norm() >= trust_radius) {
+				step = cauchy;
+			} else {
+				Eigen::VectorXd d = newton - cauchy;
+				REAL a = d.squaredNorm(), b = 2 * cauchy.dot(d), c = cauchy.squaredNorm() - trust_radius * trust_radius;
+				REAL tau = (-b + std::sqrt(b * b - 4 * a * c)) / (2 * a);
+				step = cauchy + tau * d;
+			}
+			step = project(current.params + (step.array() * free_mask(current)).matrix()) - current.params;
+
+			REAL predicted = g.dot(step) + 0.5 * step.dot(H.multiply(step));
+			Evaluation trial = evaluate(current.params + step);
+			REAL ratio = trial.valid() && predicted > 0 ? (trial.log_likelihood - current.log_likelihood) / predicted : -1;
+
+			if (ratio < 0.25) {
+				trust_radius = 0.25 * step.norm();
+			} else if (ratio > 0.75 && step.norm() >= 0.99 * trust_radius) {
+				trust_radius *= 2;
+			}
+			if (ratio > 1e-4) {
+				accept(trial);
+				return true;
+			}
+			return false;
+		}
+
+		Kernel& kernel;
+		std::function<void(Kernel&)> run_pass;
+		OptimizerOptions options;
+		Evaluation current;
+		//Parameters of the kernel's last pass.
+		Eigen::VectorXd loaded_params;
+		Eigen::VectorXd lower, upper;
+		REAL trust_radius;
+		int passes, iterations;
+		std::deque<Eigen::VectorXd> steps, gradient_changes;
+};
+
+#endif //OPTIMIZER_H
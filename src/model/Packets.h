@@ -0,0 +1,135 @@
+#ifndef PACKETS_H
+#define PACKETS_H
+
+#include <vector>
+#include <cmath>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+#include "Parse.h"
+
+/*
+ * The messages of one exchange event (e.g. a match with its trade, fills and cancels) as a view into a contiguous
+ * buffer of events owned by someone else.
+ * The CSV carries neither the sequence number nor F_LAST, so an exchange event is taken to be a maximal run of
+ * consecutive messages with the same ts_event, which the exchange stamps on every message of one matching event.
+ */
+struct EventPacket {
+	const Event* first;
+	const Event* last;
+
+	const Event* begin() const {
+		return first;
+	}
+
+	const Event* end() const {
+		return last;
+	}
+
+	size_t size() const {
+		return last - first;
+	}
+
+	REAL time() const {
+		return first->time;
+	}
+
+	//The first trade message (the aggressor's side), or nullptr if nothing traded.
+	const Event* trade() const {
+		for (const Event* event = first; event != last; event++) {
+			if (event_action(event->event_type) == TRADE) {
+				return event;
+			}
+		}
+		return nullptr;
+	}
+};
+
+//Calls visit(packet) for each exchange event in events, in order, in one linear pass and without copying.
+template <class Visitor>
+void for_each_packet(const std::vector<Event>& events, Visitor visit) {
+	const Event* data = events.data();
+	size_t start = 0;
+	for (size_t i = 1; i <= events.size(); i++) {
+		if (i == events.size() || events[i].time != events[start].time) {
+			visit(EventPacket{data + start, data + i});
+			start = i;
+		}
+	}
+}
+
+/*
+ * Collapses a packet into one event, written into out (whose marks are reused, so this does not allocate once out
+ * has NUM_BOOK_MARKS marks). A packet that traded becomes its first trade's type, with that side's total traded size
+ * and the trade or fill price furthest from the first trade's (how far the sweep went, even when one trade message
+ * covers fills at several levels); any other packet keeps its first message's type and order. The BBO
+ * marks are those after the last message, i.e. the book after the whole exchange event.
+ */
+void aggregate(const EventPacket& packet, Event& out) {
+	const Event& closing = *(packet.last - 1);
+	const Event* trade = packet.trade();
+	const Event& leading = trade ? *trade : *packet.first;
+	out.time = packet.time();
+	out.event_type = leading.event_type;
+	out.weight = 1.0;
+	out.marks = closing.marks;
+	if (trade && out.marks.size() > ORDER_PRICE) {
+		double traded = 0, first_price = trade->marks[ORDER_PRICE];
+		out.marks[ORDER_PRICE] = first_price;
+		BookSide aggressor = event_side(trade->event_type);
+		for (const Event& event : packet) {
+			//Only the first trade's side counts, with the fills of the resting orders it hit.
+			OrderAction action = event_action(event.event_type);
+			BookSide side = event_side(event.event_type);
+			bool matched = (action == TRADE && side == aggressor) || (action == FILL && side != aggressor);
+			if (action == TRADE && matched) {
+				traded += event.marks[ORDER_SIZE];
+			}
+			double price = event.marks[ORDER_PRICE];
+			if (matched && std::abs(price - first_price) > std::abs(out.marks[ORDER_PRICE] - first_price)) {
+				out.marks[ORDER_PRICE] = price;
+			}
+		}
+		out.marks[ORDER_SIZE] = traded;
+	} else if (out.marks.size() > ORDER_PRICE) {
+		out.marks[ORDER_SIZE] = leading.marks[ORDER_SIZE];
+		out.marks[ORDER_PRICE] = leading.marks[ORDER_PRICE];
+	}
+}
+
+/*
+ * Streams a session file as exchange-event packets. The parser only holds one message at a time, so each packet's
+ * messages are copied once into a buffer that is reused (and only grows to the longest packet); the packet handed
+ * out stays valid until the next call to next().
+ */
+class PacketStream {
+	public:
+		PacketStream(Realisation& realisation) : cursor(realisation.begin()) {}
+
+		bool next(EventPacket& packet) {
+			if (cursor.at_end()) {
+				return false;
+			}
+			size_t count = 0;
+			REAL time = (*cursor)->time;
+			while (!cursor.at_end() && (*cursor)->time == time) {
+				if (count < buffer.size()) {
+					//Copy-assigning into an existing slot reuses its marks.
+					buffer[count] = **cursor;
+				} else {
+					buffer.push_back(**cursor);
+				}
+				count++;
+				++cursor;
+			}
+			packet = EventPacket{buffer.data(), buffer.data() + count};
+			return true;
+		}
+
+	private:
+		EventIterator cursor;
+		std::vector<Event> buffer;
+};
+
+#endif //PACKETS_H
@@ -0,0 +1,207 @@
+#ifndef PARAMETERSTORE_H
+#define PARAMETERSTORE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <cstdint>
+#include <cmath>
+#include <filesystem>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+#include "Hessian.h"
+#include "Kernel.h"
+
+//One fitted session: what was fitted (key), over which window, and enough to restart or pool the fit later.
+struct FitRecord {
+	std::string key;
+	REAL start_time, end_time, log_likelihood;
+	Eigen::VectorXd params;
+	StructuredHessian hessian;
+	Eigen::VectorXd statistics;
+};
+
+//Captures a kernel's state after a fit; its last pass must be at its current parameters, as Optimizer::maximise leaves it.
+FitRecord make_fit_record(Kernel& kernel, const std::string& key) {
+	auto [hessian, gradient] = kernel.get_structured_hessian_and_gradient();
+	return {key, kernel.start_time, kernel.end_time, kernel.get_log_likelihood(), kernel.get_params(), hessian, kernel.get_sufficient_statistics()};
+}
+
+/*
+ * Append-only binary file of FitRecords, so a nightly job can warm-start each kernel from its previous fit.
+ * The key should name the instrument and the kernel (with its dimensions), e.g. "ES/PoissonKernel/12"; an entry is
+ * only compatible if it has the same key and number of parameters. The whole file is indexed by key on construction,
+ * and a record cut short by a crashed writer is dropped (and truncated away before the next save) rather than failing
+ * the load.
+ * Layout: the magic bytes, then per record
+ *	u32 key length, key bytes, f64 start_time, end_time, log_likelihood,
+ *	u32 n, f64[n] params, u32 structure, u32 width, u32 rows, u32 cols, f64[rows*cols] hessian data (column-major),
+ *	u32 m, f64[m] statistics
+ */
+class ParameterStore {
+	public:
+		ParameterStore(std::string filename) : filename(filename) {
+			std::ifstream file(filename, std::ios::binary);
+			if (!file) {
+				return;
+			}
+			//An empty file, or one cut short inside the magic bytes, is a store whose first save crashed: start it afresh.
+			char header[sizeof(magic)];
+			file.read(header, sizeof(magic));
+			if (file.gcount() < (std::streamsize)sizeof(magic) && std::string(header, file.gcount()) == std::string(magic, file.gcount())) {
+				return;
+			}
+			if (std::string(header, file.gcount()) != std::string(magic, sizeof(magic))) {
+				std::cerr << filename << " is not a parameter store" << std::endl;
+				valid = false;
+				return;
+			}
+			valid_length = file.tellg();
+			while (std::optional<FitRecord> record = read_record(file)) {
+				records[record->key].push_back(*record);
+				valid_length = file.tellg();
+			}
+		}
+
+		//Appends the record; false (with a message) if the file is not a parameter store or could not be written.
+		bool save(const FitRecord& record) {
+			if (!valid) {
+				std::cerr << "not saving to " << filename << ", which is not a parameter store" << std::endl;
+				return false;
+			}
+			if (valid_length == 0) {
+				std::ofstream header(filename, std::ios::binary | std::ios::trunc);
+				if (!header.write(magic, sizeof(magic)).flush()) {
+					std::cerr << "could not write " << filename << std::endl;
+					return false;
+				}
+				valid_length = sizeof(magic);
+			} else if (std::filesystem::file_size(filename) > valid_length) {
+				std::filesystem::resize_file(filename, valid_length);
+			}
+			std::ofstream file(filename, std::ios::binary | std::ios::app);
+			write_record(file, record);
+			if (!file.flush()) {
+				std::cerr << "could not write " << filename << std::endl;
+				return false;
+			}
+			valid_length = std::filesystem::file_size(filename);
+			records[record.key].push_back(record);
+			return true;
+		}
+
+		//Latest-ending compatible fit that ended no later than before.
+		std::optional<FitRecord> latest(const std::string& key, int num_params, REAL before=INFINITY) const {
+			auto entries = records.find(key);
+			if (entries == records.end()) {
+				return std::nullopt;
+			}
+			const FitRecord* best = nullptr;
+			for (const FitRecord& record : entries->second) {
+				if (record.params.size() == num_params && record.end_time <= before && (!best || record.end_time > best->end_time)) {
+					best = &record;
+				}
+			}
+			return best ? std::optional<FitRecord>(*best) : std::nullopt;
+		}
+
+		//Sets the kernel's parameters from the latest compatible fit ending by the kernel's start; false if there is none.
+		bool warm_start(Kernel& kernel, const std::string& key) const {
+			std::optional<FitRecord> record = latest(key, kernel.get_params().size(), kernel.start_time);
+			if (record) {
+				kernel.set_params(record->params);
+			}
+			return (bool)record;
+		}
+
+		int size(const std::string& key) const {
+			auto entries = records.find(key);
+			return entries == records.end() ? 0 : entries->second.size();
+		}
+
+	private:
+		static constexpr char magic[8] = {'O', 'B', 'S', 'F', 'I', 'T', 'S', '1'};
+
+		static void write_u32(std::ofstream& file, uint32_t value) {
+			file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+		}
+
+		static void write_f64(std::ofstream& file, double value) {
+			file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+		}
+
+		static void write_doubles(std::ofstream& file, const double* values, size_t count) {
+			file.write(reinterpret_cast<const char*>(values), count * sizeof(double));
+		}
+
+		static void write_record(std::ofstream& file, const FitRecord& record) {
+			write_u32(file, record.key.size());
+			file.write(record.key.data(), record.key.size());
+			write_f64(file, record.start_time);
+			write_f64(file, record.end_time);
+			write_f64(file, record.log_likelihood);
+			write_u32(file, record.params.size());
+			write_doubles(file, record.params.data(), record.params.size());
+			write_u32(file, record.hessian.structure);
+			write_u32(file, record.hessian.width);
+			write_u32(file, record.hessian.data.rows());
+			write_u32(file, record.hessian.data.cols());
+			write_doubles(file, record.hessian.data.data(), record.hessian.data.size());
+			write_u32(file, record.statistics.size());
+			write_doubles(file, record.statistics.data(), record.statistics.size());
+		}
+
+		static bool read_u32(std::ifstream& file, uint32_t& value) {
+			return (bool)file.read(reinterpret_cast<char*>(&value), sizeof(value));
+		}
+
+		static bool read_f64(std::ifstream& file, REAL& value) {
+			double raw;
+			bool ok = (bool)file.read(reinterpret_cast<char*>(&raw), sizeof(raw));
+			value = raw;
+			return ok;
+		}
+
+		static bool read_doubles(std::ifstream& file, double* values, size_t count) {
+			return (bool)file.read(reinterpret_cast<char*>(values), count * sizeof(double));
+		}
+
+		static std::optional<FitRecord> read_record(std::ifstream& file) {
+			FitRecord record{"", 0, 0, 0, Eigen::VectorXd(), StructuredHessian::dense(Eigen::MatrixXd()), Eigen::VectorXd()};
+			uint32_t key_length, num_params, structure, width, rows, cols, num_statistics;
+			if (!read_u32(file, key_length)) {
+				return std::nullopt;
+			}
+			record.key.resize(key_length);
+			if (!file.read(record.key.data(), key_length) || !read_f64(file, record.start_time) || !read_f64(file, record.end_time) || !read_f64(file, record.log_likelihood) || !read_u32(file, num_params)) {
+				return std::nullopt;
+			}
+			record.params.resize(num_params);
+			if (!read_doubles(file, record.params.data(), num_params) || !read_u32(file, structure) || !read_u32(file, width) || !read_u32(file, rows) || !read_u32(file, cols)) {
+				return std::nullopt;
+			}
+			Eigen::MatrixXd data(rows, cols);
+			if (!read_doubles(file, data.data(), data.size()) || !read_u32(file, num_statistics)) {
+				return std::nullopt;
+			}
+			record.hessian = StructuredHessian((HessianStructure)structure, width, data);
+			record.statistics.resize(num_statistics);
+			if (!read_doubles(file, record.statistics.data(), num_statistics)) {
+				return std::nullopt;
+			}
+			return record;
+		}
+
+		std::string filename;
+		bool valid = true;
+		//Bytes up to the end of the last complete record; zero if the file does not exist yet or has no complete header.
+		uintmax_t valid_length = 0;
+		std::map<std::string, std::vector<FitRecord>> records;
+};
+
+#endif //PARAMETERSTORE_H
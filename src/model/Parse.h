@@ -5,13 +5,93 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <iterator>
+#include <optional>
 #include <cassert>
 
 #include "Types.h"
 
 const int seconds_in_day = 60*60*24;
+// Order prices are written in databento's fixed-point units; the BBO columns are already scaled.
+const double fixed_price_scale = 1e9;
+
+// Instrument, time and event type of a CSV line, without parsing its other columns; false for lines EventIterator skips.
+bool parse_record_key(const std::string& line, std::string_view& instrument, REAL& time, int& event_type) {
+	static const std::string actions = "ACMTF";
+	size_t instrument_end = line.find(',');
+	size_t time_end = instrument_end == std::string::npos ? instrument_end : line.find(',', instrument_end + 1);
+	if (time_end == std::string::npos || time_end + 4 >= line.size()) {
+		return false;
+	}
+	size_t action = actions.find(line[time_end + 1]);
+	char side = line[time_end + 3];
+	if (action == std::string::npos || (side != 'A' && side != 'B')) {
+		return false;
+	}
+	instrument = std::string_view(line.data(), instrument_end);
+	time = std::stod(line.substr(instrument_end + 1, time_end - instrument_end - 1));
+	event_type = (action + 1) * 2 + (side == 'A');
+	return true;
+}
+
+// The event on one CSV line, or nothing for lines EventIterator skips (other actions, or no side).
+std::optional<Event> parse_event(const std::string& line) {
+	std::stringstream lineStream(line);
+	std::string cell;
+	std::vector<std::string> currentRow;
+
+	while (std::getline(lineStream, cell, ',')) {
+		currentRow.push_back(cell);
+	}
+
+	// instrument,ts_event,ts_recv,seconds_since_start,order_id,action,side,size,price,bq,bp,aq,apES,1726617600001337031,1726617600001502573,0.001337031,6413845537760,C,A,1,5644250000000,11,5644.0,5,5644.25
+	// ES,1726617600001338261,1726617600001502573,0.001338261,6413845537764,C,A,1,5644250000000,11,5644.0,4,5644.25
+	assert(currentRow.size() == 12);
+
+	std::string ticker = currentRow[0];
+	long double time = std::stod(currentRow[1]);
+	std::string action = currentRow[2];
+	std::string side = currentRow[3];
+	int size = std::stoi(currentRow[4]);
+	double price = std::stod(currentRow[5]);
+	// Sizes are parsed as doubles since a one-sided book is written as nan.
+	double bq = std::stod(currentRow[7]);
+	double bp = std::stod(currentRow[8]);
+	double aq = std::stod(currentRow[9]);
+	double ap = std::stod(currentRow[10]);
+
+	//'AB', 'AA', 'CB', 'CA', 'MA', 'MB', 'TA', 'FB', 'TB', 'FA'
+	int event_type = -1;
+	if (action=="A") {
+		event_type = 1;
+	} else if (action=="C") {
+		event_type = 2;
+	} else if (action=="M") {
+		event_type = 3;
+	} else if (action=="T") {
+		event_type = 4;
+	} else if (action=="F") {
+		event_type = 5;
+	}
+
+	if (event_type != -1) {
+		event_type *= 2;
+		if (side=="A") {
+			event_type += 1;
+		} else if (side=="N") {
+			event_type = -1;
+		}
+	}
+
+	if (event_type==-1) {
+		return std::nullopt;
+	}
+	Eigen::VectorXd marks(NUM_BOOK_MARKS);
+	marks << bq, bp, aq, ap, size, price / fixed_price_scale;
+	return Event(time, event_type, marks, 1.0);
+}
 
 class EventIterator {
 	public:
@@ -21,11 +101,22 @@ class EventIterator {
 			} else {
 				std::string line;
 				std::getline(file, line);	
+				nextOffset = line.size() + 1;
 				readNextLine();
 			}
 		}
 
-		bool operator!=(const EventIterator& other) const {
+		// Resumes at a byte offset previously given by offset(), without skipping a header line.
+		EventIterator(const std::string& filename, std::streamoff start) : file(filename), done(false), nextOffset(start) {
+			if (!file.is_open()) {
+				done = true;
+			} else {
+				file.seekg(start);
+				readNextLine();
+			}
+		}
+
+		bool operator!=(const EventIterator& /*other*/) const {
 			return !done;
 		}
 
@@ -38,76 +129,37 @@ class EventIterator {
 			return *this;
 		}
 
+		bool at_end() const {
+			return done;
+		}
+
+		// Byte offset of the line the current event was read from.
+		std::streamoff offset() const {
+			return currentOffset;
+		}
+
 	private:
 		std::ifstream file;
-		std::vector<std::string> currentRow;
 		Event *currentEvent = NULL;
 		bool done;
+		// Counted from line lengths rather than tellg(), which costs a seek per line.
+		std::streamoff nextOffset = 0, currentOffset = 0;
 
 		void readNextLine() {
 			std::string line;
-			if (std::getline(file, line)) {
-				std::stringstream lineStream(line);
-				std::string cell;
-				currentRow.clear();
-
-				while (std::getline(lineStream, cell, ',')) {
-					currentRow.push_back(cell);
-				}
-
-				// instrument,ts_event,ts_recv,seconds_since_start,order_id,action,side,size,price,bq,bp,aq,apES,1726617600001337031,1726617600001502573,0.001337031,6413845537760,C,A,1,5644250000000,11,5644.0,5,5644.25
-				// ES,1726617600001338261,1726617600001502573,0.001338261,6413845537764,C,A,1,5644250000000,11,5644.0,4,5644.25
-				assert(currentRow.size() == 12);
-
-				std::string ticker = currentRow[0];
-				long double ts_event = std::stod(currentRow[1]);
-				long double ts_recv = std::stod(currentRow[1]);
-				long double time = std::stod(currentRow[1]);
-				std::string action = currentRow[2];
-				std::string side = currentRow[3];
-				int size = std::stoi(currentRow[4]);
-				double price = std::stod(currentRow[5]);
-				double ts_delta = std::stod(currentRow[6]);
-				int bq = 0;//std::stoi(currentRow[7]);
-				double bp = 0;//std::stod(currentRow[8]);
-				int aq = 0;//std::stoi(currentRow[9]);
-				double ap = 0;//std::stod(currentRow[10]);
-
-				//'AB', 'AA', 'CB', 'CA', 'MA', 'MB', 'TA', 'FB', 'TB', 'FA'
-				int event_type = -1;
-				if (action=="A") {
-					event_type = 1;
-				} else if (action=="C") {
-					event_type = 2;
-				} else if (action=="M") {
-					event_type = 3;
-				} else if (action=="T") {
-					event_type = 4;
-				} else if (action=="F") {
-					event_type = 5;
-				}
-
-				if (event_type != -1) {
-					event_type *= 2;
-					if (side=="A") {
-						event_type += 1;
-					} else if (side=="N") {
-						event_type = -1;
-					}
-				}
-
-				if (event_type==-1) {
-					readNextLine();
-				} else {
+			while (std::getline(file, line)) {
+				std::streamoff lineOffset = nextOffset;
+				nextOffset += line.size() + 1;
+				if (std::optional<Event> event = parse_event(line)) {
 					if (currentEvent) {
 						delete currentEvent;
 					}
-					currentEvent = new Event(time, event_type, {}, 1.0);
+					currentEvent = new Event(std::move(*event));
+					currentOffset = lineOffset;
+					return;
 				}
-
-			} else {
-				done = true; // No more lines to read
 			}
+			done = true; // No more lines to read
 		}
 };
 
@@ -123,6 +175,10 @@ public:
         return EventIterator("");
     }
 
+    EventIterator begin_at(std::streamoff offset) {
+        return EventIterator(filename, offset);
+    }
+
 private:
     std::string filename;
 };
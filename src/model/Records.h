@@ -0,0 +1,350 @@
+#ifndef RECORDS_H
+#define RECORDS_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <filesystem>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Types.h"
+#include "Parse.h"
+
+//Read-only map of a whole file, closed with the object.
+class MappedFile {
+	public:
+		MappedFile(const std::string& filename) {
+			descriptor = ::open(filename.c_str(), O_RDONLY);
+			struct stat status;
+			if (descriptor < 0 || fstat(descriptor, &status) != 0) {
+				std::cerr << "could not open " << filename << std::endl;
+				return;
+			}
+			size = status.st_size;
+			if (size == 0) {
+				return;
+			}
+			void* address = mmap(nullptr, size, PROT_READ, MAP_SHARED, descriptor, 0);
+			if (address == MAP_FAILED) {
+				std::cerr << "could not map " << filename << std::endl;
+				size = 0;
+				return;
+			}
+			data = static_cast<const char*>(address);
+		}
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		~MappedFile() {
+			if (data) {
+				munmap(const_cast<char*>(data), size);
+			}
+			if (descriptor >= 0) {
+				::close(descriptor);
+			}
+		}
+
+		//The line starting at offset, without its newline.
+		std::string_view line(uint64_t offset) const {
+			if (offset >= size) {
+				return {};
+			}
+			const char* end = static_cast<const char*>(std::memchr(data + offset, '\n', size - offset));
+			return std::string_view(data + offset, (end ? end : data + size) - (data + offset));
+		}
+
+		const char* data = nullptr;
+		size_t size = 0;
+
+	private:
+		int descriptor = -1;
+};
+
+/*
+ * Secondary index of one session CSV by event type: for every type, the record numbers (counted as EventIterator
+ * counts events) and byte offsets of its lines, in file order. Built with one pass of parse_record_key and saved next
+ * to the file (filename + ".types"), then mapped rather than read, so opening it costs nothing until a type's lists
+ * are touched. An index whose recorded file size or modification time no longer matches is rebuilt.
+ * Layout: the magic bytes, u64 csv size, i64 modified, u64 num_records, u32 num_types, u32 padding, u64[num_types] counts,
+ *	then per type u64[count] records followed by u64[count] offsets
+ */
+class TypeIndex {
+	public:
+		TypeIndex(const std::string& filename) : filename(filename) {
+			if (!std::filesystem::exists(filename)) {
+				std::cerr << "could not open " << filename << std::endl;
+				return;
+			}
+			if (!map() || !current()) {
+				unmap();
+				build();
+				if (!map() || !current()) {
+					std::cerr << "could not index " << filename << std::endl;
+					unmap();
+				}
+			}
+		}
+
+		TypeIndex(const TypeIndex&) = delete;
+		TypeIndex& operator=(const TypeIndex&) = delete;
+
+		~TypeIndex() {
+			unmap();
+		}
+
+		size_t count(int event_type) const {
+			return valid(event_type) ? counts()[event_type] : 0;
+		}
+
+		const uint64_t* records(int event_type) const {
+			return valid(event_type) ? words() + list_start[event_type] : nullptr;
+		}
+
+		const uint64_t* offsets(int event_type) const {
+			return valid(event_type) ? words() + list_start[event_type] + counts()[event_type] : nullptr;
+		}
+
+		//Events of every type in the session.
+		uint64_t num_records() const {
+			return data ? header().num_records : 0;
+		}
+
+		int num_types() const {
+			return data ? header().num_types : 0;
+		}
+
+		std::string filename;
+
+	private:
+		static constexpr char magic[8] = {'O', 'B', 'S', 'T', 'Y', 'P', 'E', '1'};
+
+		struct Header {
+			char magic[8];
+			uint64_t csv_size;
+			int64_t modified;
+			uint64_t num_records;
+			uint32_t num_types;
+			uint32_t padding;
+		};
+
+		static int64_t modified_time(const std::string& path) {
+			return std::filesystem::last_write_time(path).time_since_epoch().count();
+		}
+
+		const Header& header() const {
+			return *reinterpret_cast<const Header*>(data);
+		}
+
+		const uint64_t* counts() const {
+			return reinterpret_cast<const uint64_t*>(data + sizeof(Header));
+		}
+
+		//The file as u64 words, which the type lists are laid out in.
+		const uint64_t* words() const {
+			return reinterpret_cast<const uint64_t*>(data);
+		}
+
+		bool valid(int event_type) const {
+			return data && event_type >= 0 && event_type < (int)header().num_types;
+		}
+
+		bool map() {
+			descriptor = ::open((filename + ".types").c_str(), O_RDONLY);
+			struct stat status;
+			if (descriptor < 0 || fstat(descriptor, &status) != 0 || (size_t)status.st_size < sizeof(Header)) {
+				return false;
+			}
+			size = status.st_size;
+			void* address = mmap(nullptr, size, PROT_READ, MAP_SHARED, descriptor, 0);
+			if (address == MAP_FAILED) {
+				return false;
+			}
+			data = static_cast<const char*>(address);
+			return true;
+		}
+
+		void unmap() {
+			if (data) {
+				munmap(const_cast<char*>(data), size);
+			}
+			if (descriptor >= 0) {
+				::close(descriptor);
+			}
+			data = nullptr;
+			descriptor = -1;
+			size = 0;
+			list_start.clear();
+		}
+
+		//Checks the mapped index belongs to the file as it is now and is complete, and finds where each list starts.
+		bool current() {
+			const Header& stored = header();
+			if (std::memcmp(stored.magic, magic, sizeof(magic)) != 0 || stored.csv_size != std::filesystem::file_size(filename) || stored.modified != modified_time(filename)) {
+				return false;
+			}
+			size_t position = (sizeof(Header) + stored.num_types * sizeof(uint64_t)) / sizeof(uint64_t);
+			if (size < position * sizeof(uint64_t)) {
+				return false;
+			}
+			for (uint32_t type = 0; type < stored.num_types; type++) {
+				list_start.push_back(position);
+				position += 2 * counts()[type];
+			}
+			return size == position * sizeof(uint64_t);
+		}
+
+		void build() const {
+			std::vector<std::vector<uint64_t>> records(num_order_event_types), offsets(num_order_event_types);
+			std::ifstream file(filename);
+			std::string line;
+			uint64_t record = 0;
+			if (std::getline(file, line)) {
+				uint64_t offset = line.size() + 1;
+				std::string_view instrument;
+				REAL time;
+				int event_type;
+				while (std::getline(file, line)) {
+					uint64_t line_offset = offset;
+					offset += line.size() + 1;
+					if (!parse_record_key(line, instrument, time, event_type)) {
+						continue;
+					}
+					records[event_type].push_back(record++);
+					offsets[event_type].push_back(line_offset);
+				}
+			}
+
+			Header stored{};
+			std::memcpy(stored.magic, magic, sizeof(magic));
+			stored.csv_size = std::filesystem::file_size(filename);
+			stored.modified = modified_time(filename);
+			stored.num_records = record;
+			stored.num_types = num_order_event_types;
+			std::string temporary = filename + ".types.tmp";
+			{
+				std::ofstream out(temporary, std::ios::binary);
+				out.write(reinterpret_cast<const char*>(&stored), sizeof(stored));
+				for (const std::vector<uint64_t>& list : records) {
+					uint64_t count = list.size();
+					out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+				}
+				for (int type = 0; type < num_order_event_types; type++) {
+					out.write(reinterpret_cast<const char*>(records[type].data()), records[type].size() * sizeof(uint64_t));
+					out.write(reinterpret_cast<const char*>(offsets[type].data()), offsets[type].size() * sizeof(uint64_t));
+				}
+			}
+			std::filesystem::rename(temporary, filename + ".types");
+		}
+
+		int descriptor = -1;
+		const char* data = nullptr;
+		size_t size = 0;
+		std::vector<size_t> list_start;
+};
+
+/*
+ * The events of some types from one session, in file order, read by gathering just their lines from the mapped CSV
+ * through its TypeIndex, so a trade-only model never parses the adds, cancels and modifies around them. Iterates
+ * like Realisation (for (const Event* event : subset)), and record() gives each event's number in the full session.
+ */
+class RecordSubset {
+	public:
+		RecordSubset(const std::string& filename, const std::vector<int>& event_types) : index(filename), csv(filename) {
+			for (int type : event_types) {
+				size_t n = index.count(type);
+				const uint64_t* type_records = index.records(type);
+				const uint64_t* type_offsets = index.offsets(type);
+				for (size_t i = 0; i < n; i++) {
+					entries.push_back({type_records[i], type_offsets[i]});
+				}
+			}
+			//Each type's list is already in order, so this only interleaves them.
+			std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+				return a.record < b.record;
+			});
+		}
+
+		class Iterator {
+			public:
+				Iterator(const RecordSubset* subset, size_t position) : subset(subset), position(position) {
+					load();
+				}
+
+				bool operator!=(const Iterator& other) const {
+					return position != other.position;
+				}
+
+				const Event* operator*() const {
+					return current ? &*current : nullptr;
+				}
+
+				Iterator& operator++() {
+					position++;
+					load();
+					return *this;
+				}
+
+				uint64_t record() const {
+					return subset->entries[position].record;
+				}
+
+			private:
+				void load() {
+					current.reset();
+					if (position < subset->entries.size()) {
+						line.assign(subset->csv.line(subset->entries[position].offset));
+						current = parse_event(line);
+					}
+				}
+
+				const RecordSubset* subset;
+				size_t position;
+				std::string line;
+				std::optional<Event> current;
+		};
+
+		Iterator begin() const {
+			return Iterator(this, 0);
+		}
+
+		Iterator end() const {
+			return Iterator(this, entries.size());
+		}
+
+		size_t size() const {
+			return entries.size();
+		}
+
+		//Record number in the full session of the i-th event of the subset.
+		uint64_t record(size_t i) const {
+			return entries[i].record;
+		}
+
+		TypeIndex index;
+
+	private:
+		struct Entry {
+			uint64_t record, offset;
+		};
+
+		MappedFile csv;
+		std::vector<Entry> entries;
+};
+
+//Trades on either side, the records databento_parse_trades_only.py extracts.
+inline std::vector<int> trade_event_types() {
+	return {make_event_type(TRADE, BID), make_event_type(TRADE, ASK)};
+}
+
+#endif //RECORDS_H
@@ -0,0 +1,228 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <optional>
+#include <filesystem>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+#include "Types.h"
+#include "Parse.h"
+#include "Book.h"
+
+//Where to resume a session: the first event at or after time, its byte offset and record number, and the book before it.
+struct ReplayCheckpoint {
+	REAL time;
+	std::streamoff offset;
+	long record;
+	BookSnapshot book;
+};
+
+/*
+ * Sparse seek index for one session CSV: a checkpoint at the first event of every interval seconds.
+ * Built with one pass over the file and saved next to it (filename + ".replay") so that later sessions load it
+ * instead; an index whose recorded file size, tick size or interval no longer matches is rebuilt.
+ * Layout: the magic bytes, u64 csv size, f64 tick_size, f64 interval, u32 count, then per checkpoint
+ *	f64 time, i64 offset, i64 record, then per side i64 last_touch, u32 n, n x (i64 tick, f64 size)
+ */
+class ReplayIndex {
+	public:
+		static ReplayIndex open(const std::string& filename, REAL tick_size, REAL interval=60) {
+			if (std::optional<ReplayIndex> index = load(filename, tick_size, interval)) {
+				return *index;
+			}
+			ReplayIndex index = build(filename, tick_size, interval);
+			index.save(filename);
+			return index;
+		}
+
+		static ReplayIndex build(const std::string& filename, REAL tick_size, REAL interval=60) {
+			ReplayIndex index(tick_size, interval);
+			L2Book book(tick_size);
+			Realisation session(filename);
+			long record = 0;
+			REAL next_checkpoint = -INFINITY;
+			for (EventIterator event = session.begin(); !event.at_end(); ++event, record++) {
+				const Event& observation = **event;
+				if (observation.time >= next_checkpoint) {
+					index.checkpoints.push_back({observation.time, event.offset(), record, book.snapshot()});
+					next_checkpoint = (std::floor(observation.time / interval) + 1) * interval;
+				}
+				book.apply(observation);
+			}
+			return index;
+		}
+
+		//Last checkpoint at or before time, or the first one if time is before the session.
+		const ReplayCheckpoint& before(REAL time) const {
+			auto after = std::upper_bound(checkpoints.begin(), checkpoints.end(), time, [](REAL t, const ReplayCheckpoint& checkpoint) {
+				return t < checkpoint.time;
+			});
+			return after == checkpoints.begin() ? checkpoints.front() : *(after - 1);
+		}
+
+		bool empty() const {
+			return checkpoints.empty();
+		}
+
+		REAL tick_size, interval;
+		std::vector<ReplayCheckpoint> checkpoints;
+
+	private:
+		ReplayIndex(REAL tick_size, REAL interval) : tick_size(tick_size), interval(interval) {}
+
+		static constexpr char magic[8] = {'O', 'B', 'S', 'R', 'P', 'L', 'Y', '1'};
+
+		template <class T>
+		static void write(std::ofstream& file, T value) {
+			file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+		}
+
+		template <class T>
+		static bool read(std::ifstream& file, T& value) {
+			return (bool)file.read(reinterpret_cast<char*>(&value), sizeof(value));
+		}
+
+		void save(const std::string& filename) const {
+			std::ofstream file(filename + ".replay", std::ios::binary);
+			file.write(magic, sizeof(magic));
+			write<uint64_t>(file, std::filesystem::file_size(filename));
+			write<double>(file, tick_size);
+			write<double>(file, interval);
+			write<uint32_t>(file, checkpoints.size());
+			for (const ReplayCheckpoint& checkpoint : checkpoints) {
+				write<double>(file, checkpoint.time);
+				write<int64_t>(file, checkpoint.offset);
+				write<int64_t>(file, checkpoint.record);
+				for (int side = BID; side <= ASK; side++) {
+					write<int64_t>(file, checkpoint.book.last_touch[side]);
+					write<uint32_t>(file, checkpoint.book.levels[side].size());
+					for (const auto& [tick, size] : checkpoint.book.levels[side]) {
+						write<int64_t>(file, tick);
+						write<double>(file, size);
+					}
+				}
+			}
+		}
+
+		static std::optional<ReplayIndex> load(const std::string& filename, REAL tick_size, REAL interval) {
+			std::ifstream file(filename + ".replay", std::ios::binary);
+			char header[sizeof(magic)];
+			uint64_t csv_size;
+			double stored_tick_size, stored_interval;
+			uint32_t count;
+			if (!file || !file.read(header, sizeof(magic)) || std::string(header, sizeof(magic)) != std::string(magic, sizeof(magic)) || !read(file, csv_size) || !read(file, stored_tick_size) || !read(file, stored_interval) || !read(file, count)) {
+				return std::nullopt;
+			}
+			if (!std::filesystem::exists(filename) || csv_size != std::filesystem::file_size(filename) || stored_tick_size != (double)tick_size || stored_interval != (double)interval) {
+				return std::nullopt;
+			}
+			ReplayIndex index(tick_size, interval);
+			index.checkpoints.resize(count);
+			for (ReplayCheckpoint& checkpoint : index.checkpoints) {
+				double time;
+				int64_t offset, record;
+				if (!read(file, time) || !read(file, offset) || !read(file, record)) {
+					return std::nullopt;
+				}
+				checkpoint.time = time;
+				checkpoint.offset = offset;
+				checkpoint.record = record;
+				for (int side = BID; side <= ASK; side++) {
+					int64_t last_touch;
+					uint32_t levels;
+					if (!read(file, last_touch) || !read(file, levels)) {
+						return std::nullopt;
+					}
+					checkpoint.book.last_touch[side] = last_touch;
+					checkpoint.book.levels[side].resize(levels);
+					for (auto& [tick, size] : checkpoint.book.levels[side]) {
+						int64_t stored_tick;
+						if (!read(file, stored_tick) || !read(file, size)) {
+							return std::nullopt;
+						}
+						tick = stored_tick;
+					}
+				}
+			}
+			return index;
+		}
+};
+
+/*
+ * Replays a session CSV through an L2Book from any point in time.
+ * seek(t) restores the nearest checkpoint's book and replays only the events between it and t, so jumping anywhere
+ * costs at most one interval of parsing; next() then continues event by event from the first event at or after t.
+ */
+class ReplayEngine {
+	public:
+		ReplayEngine(const std::string& filename, REAL tick_size, REAL interval=60) : book(tick_size), index(ReplayIndex::open(filename, tick_size, interval)), session(filename) {
+			if (!index.empty()) {
+				seek(index.checkpoints.front().time);
+			}
+		}
+
+		//Leaves the book as it was just before the first event at or after time.
+		void seek(REAL time) {
+			if (index.empty()) {
+				return;
+			}
+			const ReplayCheckpoint& checkpoint = index.before(time);
+			book.restore(checkpoint.book);
+			cursor.emplace(session.begin_at(checkpoint.offset));
+			record = checkpoint.record;
+			returned = false;
+			while (!cursor->at_end() && (**cursor)->time < time) {
+				book.apply(***cursor);
+				++*cursor;
+				record++;
+			}
+		}
+
+		//Applies the next event to the book and returns it (valid until the following call), or nullptr at the end.
+		const Event* next() {
+			return next([](const Event&) {});
+		}
+
+		//As next(), but first calls before_apply(event) while the book still shows the state the event arrived to.
+		template <class Observer>
+		const Event* next(Observer&& before_apply) {
+			if (!cursor) {
+				return nullptr;
+			}
+			//The parser owns the current event, so the cursor only moves on once the caller is done with it.
+			if (returned) {
+				++*cursor;
+				record++;
+				returned = false;
+			}
+			if (cursor->at_end()) {
+				return nullptr;
+			}
+			const Event* event = **cursor;
+			before_apply(*event);
+			book.apply(*event);
+			returned = true;
+			return event;
+		}
+
+		//Number of events applied to the book so far in the session.
+		long position() const {
+			return record + returned;
+		}
+
+		L2Book book;
+		ReplayIndex index;
+
+	private:
+		Realisation session;
+		std::optional<EventIterator> cursor;
+		long record = 0;
+		bool returned = false;
+};
+
+#endif //REPLAY_H
@@ -0,0 +1,209 @@
+#ifndef SEASONALITY_H
+#define SEASONALITY_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <cassert>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+#include "Parse.h"
+#include "Kernel.h"
+
+/*
+ * Piecewise-constant time-of-day level per event type.
+ * Bucket b covers [edges[b], edges[b+1]) seconds after midnight UTC, the first from midnight (edges[0] must be 0) and
+ * the last to midnight, so edges can be made finer around the open, the close and scheduled releases. Within-day
+ * prefix integrals are cached, so the integral between any two times is two bucket lookups.
+ */
+class SeasonalProfile {
+	public:
+		SeasonalProfile(std::vector<REAL> edges, Eigen::MatrixXd levels) : edges(edges), levels(levels) {
+			//The first bucket starts at midnight, which is where bucket() and the prefix integrals put it.
+			assert(!this->edges.empty() && this->edges.front() == 0 && std::is_sorted(this->edges.begin(), this->edges.end()));
+			int num_buckets = this->edges.size();
+			prefix = Eigen::MatrixXd::Constant(num_buckets + 1, levels.cols(), 0.0);
+			for (int b = 0; b < num_buckets; b++) {
+				prefix.row(b + 1) = prefix.row(b) + levels.row(b) * (double)(bucket_end(b) - this->edges[b]);
+			}
+		}
+
+		int num_buckets() const {
+			return edges.size();
+		}
+
+		REAL bucket_end(int b) const {
+			return b + 1 < (int)edges.size() ? edges[b + 1] : (REAL)seconds_in_day;
+		}
+
+		int bucket(REAL time_of_day) const {
+			return std::max(0, (int)(std::upper_bound(edges.begin(), edges.end(), time_of_day) - edges.begin()) - 1);
+		}
+
+		REAL value(int event_type, REAL time) const {
+			return levels(bucket(time_of_day(time)), event_type);
+		}
+
+		REAL integral(int event_type, REAL from, REAL to) const {
+			return cumulative(event_type, to) - cumulative(event_type, from);
+		}
+
+		static REAL time_of_day(REAL time) {
+			return time - std::floor(time / (REAL)seconds_in_day) * (REAL)seconds_in_day;
+		}
+
+		std::vector<REAL> edges;
+		Eigen::MatrixXd levels;
+
+	private:
+		//Integral of the profile from the start of the epoch day.
+		REAL cumulative(int event_type, REAL time) const {
+			REAL day = std::floor(time / (REAL)seconds_in_day);
+			REAL tod = time - day * (REAL)seconds_in_day;
+			int b = bucket(tod);
+			return day * prefix(num_buckets(), event_type) + prefix(b, event_type) + (tod - edges[b]) * levels(b, event_type);
+		}
+
+		Eigen::MatrixXd prefix;
+};
+
+/*
+ * Background-only kernel with a separate level per (time-of-day bucket, event type).
+ * Updates only count events into their bucket, and each bucket's exposure over [start_time, end_time] is computed
+ * once per session and cached, so the likelihood, gradient and (diagonal) Hessian cost O(buckets x types) per
+ * optimiser iteration without touching the events again.
+ * get_profile() hands the fitted shape to excitation kernels that take a SeasonalProfile as their background.
+ */
+class SeasonalBackgroundKernel : public Kernel {
+	public:
+		SeasonalBackgroundKernel(int num_event_types, REAL start_time, REAL end_time, std::vector<REAL> edges) : Kernel(num_event_types, start_time, end_time), profile(edges, Eigen::MatrixXd::Random(edges.size(), num_event_types).array() + 2.0) {
+			reset();
+		}
+
+		std::pair<Eigen::MatrixXd,Eigen::VectorXd> get_hessian_and_gradient() {
+			auto [hessian, gradient] = get_structured_hessian_and_gradient();
+			return {hessian.to_dense(), gradient};
+		}
+
+		std::pair<StructuredHessian,Eigen::VectorXd> get_structured_hessian_and_gradient() {
+			Eigen::VectorXd exposure = get_exposure();
+			Eigen::MatrixXd gradient = weighted_event_counts.cwiseQuotient(profile.levels);
+			gradient.colwise() -= exposure;
+			Eigen::MatrixXd hessian_diagonal = -weighted_event_counts.cwiseQuotient(profile.levels.cwiseProduct(profile.levels));
+
+			return {StructuredHessian::diagonal(Eigen::Map<Eigen::VectorXd>(hessian_diagonal.data(), hessian_diagonal.size())), Eigen::Map<Eigen::VectorXd>(gradient.data(), gradient.size())};
+		}
+
+		REAL get_log_likelihood() {
+			return (weighted_event_counts.array() * profile.levels.array().log()).sum() - (profile.levels.transpose() * get_exposure()).sum();
+		}
+
+		Eigen::VectorXd get_params() {
+			return Eigen::Map<Eigen::VectorXd>(profile.levels.data(), profile.levels.size());
+		}
+
+		bool statistics_depend_on_params() {
+			return false;
+		}
+
+		//Weighted counts (buckets x types, column-major), then the exposure of each bucket.
+		Eigen::VectorXd get_sufficient_statistics() {
+			Eigen::VectorXd statistics(weighted_event_counts.size() + profile.num_buckets());
+			statistics << Eigen::Map<Eigen::VectorXd>(weighted_event_counts.data(), weighted_event_counts.size()), get_exposure();
+			return statistics;
+		}
+
+		Eigen::VectorXd get_lower_bounds() {
+			return Eigen::VectorXd::Constant(profile.levels.size(), 0.0);
+		}
+
+		void set_params(Eigen::VectorXd new_params) {
+			profile = SeasonalProfile(profile.edges, Eigen::Map<Eigen::MatrixXd>(new_params.data(), profile.num_buckets(), num_event_types));
+		}
+
+		Eigen::VectorXd get_intensities() {
+			return profile.levels.row(profile.bucket(SeasonalProfile::time_of_day(current_time))).transpose();
+		}
+
+		Eigen::VectorXd get_compensators() {
+			Eigen::VectorXd compensators(num_event_types);
+			for (int i = 0; i < num_event_types; i++) {
+				compensators[i] = profile.integral(i, session_start_time, current_time);
+			}
+			return compensators;
+		}
+
+		void update(Event observation, REAL weight=1.0) {
+			//Events arrive in time order, so the bucket only needs looking up when the current one is left.
+			REAL tod = SeasonalProfile::time_of_day(observation.time);
+			if (tod < profile.edges[current_bucket] || tod >= profile.bucket_end(current_bucket)) {
+				current_bucket = profile.bucket(tod);
+			}
+			weighted_event_counts(current_bucket, observation.event_type) += weight;
+			progress_time(observation.time - current_time);
+		}
+
+		void discount(REAL factor) {
+			//Exposure up to now is frozen into the carried total so that it can be discounted with the counts.
+			end_time = current_time;
+			carried_exposure = get_exposure() * (double)factor;
+			weighted_event_counts *= (double)factor;
+			start_time = current_time;
+		}
+
+		REAL get_intensity_upper_bound() {
+			return profile.levels.rowwise().sum().maxCoeff();
+		}
+
+		void reset() {
+			current_time = start_time;
+			session_start_time = start_time;
+			current_bucket = profile.bucket(SeasonalProfile::time_of_day(start_time));
+			weighted_event_counts = Eigen::MatrixXd::Constant(profile.num_buckets(), num_event_types, 0.0);
+			carried_exposure = Eigen::VectorXd::Constant(profile.num_buckets(), 0.0);
+			cached_exposure_start = cached_exposure_end = NAN;
+		};
+
+		//Fitted levels rescaled to average one over the session, for use as a multiplicative background shape.
+		SeasonalProfile get_profile() {
+			Eigen::VectorXd exposure = get_exposure();
+			Eigen::MatrixXd shape = profile.levels;
+			for (int i = 0; i < num_event_types; i++) {
+				double total = shape.col(i).dot(exposure);
+				if (total > 0) {
+					shape.col(i) *= exposure.sum() / total;
+				}
+			}
+			return SeasonalProfile(profile.edges, shape);
+		}
+
+	private:
+		//Seconds spent in each bucket over [start_time, end_time], recomputed only when the session bounds change.
+		Eigen::VectorXd get_exposure() {
+			if (start_time != cached_exposure_start || end_time != cached_exposure_end) {
+				cached_exposure = Eigen::VectorXd::Constant(profile.num_buckets(), 0.0);
+				REAL first_day = std::floor(start_time / (REAL)seconds_in_day);
+				REAL last_day = std::floor(end_time / (REAL)seconds_in_day);
+				for (REAL day = first_day; day <= last_day; day++) {
+					for (int b = 0; b < profile.num_buckets(); b++) {
+						REAL from = std::max(start_time, day * (REAL)seconds_in_day + profile.edges[b]);
+						REAL to = std::min(end_time, day * (REAL)seconds_in_day + profile.bucket_end(b));
+						cached_exposure[b] += std::max((REAL)0, to - from);
+					}
+				}
+				cached_exposure_start = start_time;
+				cached_exposure_end = end_time;
+			}
+			return cached_exposure + carried_exposure;
+		}
+
+		SeasonalProfile profile;
+		int current_bucket;
+		REAL session_start_time, cached_exposure_start, cached_exposure_end;
+		Eigen::MatrixXd weighted_event_counts;
+		Eigen::VectorXd cached_exposure, carried_exposure;
+};
+
+#endif //SEASONALITY_H
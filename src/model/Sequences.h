@@ -0,0 +1,226 @@
+#ifndef SEQUENCES_H
+#define SEQUENCES_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <cmath>
+#include <cstdint>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+#include "Parse.h"
+
+/*
+ * Counts of event-type n-grams for n = 1..order and histograms of the time from each type to the next, for one
+ * stream of events. Counts are dense tensors (num_types^n entries for n-grams, type x type x bin for times) indexed
+ * by the types in order, oldest first, so merging is elementwise addition and conditional distributions are slices.
+ * Times fall into num_bins log-spaced bins between min_gap and max_gap, with under- and overflow in the end bins.
+ */
+class SequenceStatistics {
+	public:
+		SequenceStatistics(int num_types=num_order_event_types, int order=4, int num_bins=40, REAL min_gap=1e-9, REAL max_gap=1e3) : num_types(num_types), order(order), num_bins(num_bins), min_gap(min_gap), max_gap(max_gap), counts(order + 1), history(std::max(order - 1, 1), 0), transition_times((size_t)num_types * num_types * num_bins, 0) {
+			size_t size = 1;
+			for (int n = 1; n <= order; n++) {
+				size *= num_types;
+				counts[n].assign(size, 0);
+			}
+		}
+
+		void observe(int event_type, REAL time) {
+			if (seen > 0) {
+				REAL gap = time - last_time;
+				transition_times[((size_t)history[0] * num_types + event_type) * num_bins + bin(gap)]++;
+			}
+			//history[0] is the latest type; the n-gram ending here is history[n-2..0] then event_type.
+			size_t index = event_type, scale = num_types;
+			counts[1][index]++;
+			for (int n = 2; n <= order && n - 1 <= seen; n++) {
+				index += history[n - 2] * scale;
+				scale *= num_types;
+				counts[n][index]++;
+			}
+			for (int i = order - 2; i > 0; i--) {
+				history[i] = history[i - 1];
+			}
+			history[0] = event_type;
+			last_time = time;
+			seen++;
+		}
+
+		//Forgets the history (e.g. between sessions) without clearing the counts.
+		void break_sequence() {
+			seen = 0;
+		}
+
+		void merge(const SequenceStatistics& other) {
+			for (int n = 1; n <= order; n++) {
+				for (size_t i = 0; i < counts[n].size(); i++) {
+					counts[n][i] += other.counts[n][i];
+				}
+			}
+			for (size_t i = 0; i < transition_times.size(); i++) {
+				transition_times[i] += other.transition_times[i];
+			}
+		}
+
+		//Count of the n-gram given oldest first.
+		uint64_t count(const std::vector<int>& types) const {
+			size_t index = 0;
+			for (int type : types) {
+				index = index * num_types + type;
+			}
+			return counts[types.size()][index];
+		}
+
+		//P(next | context) for every next type, with context oldest first (shorter than order); NaN if the context never occurred.
+		Eigen::VectorXd conditional(const std::vector<int>& context) const {
+			size_t base = 0;
+			for (int type : context) {
+				base = base * num_types + type;
+			}
+			Eigen::VectorXd probabilities(num_types);
+			const std::vector<uint64_t>& table = counts[context.size() + 1];
+			for (int next = 0; next < num_types; next++) {
+				probabilities[next] = table[base * num_types + next];
+			}
+			return probabilities / probabilities.sum();
+		}
+
+		//Row-stochastic type -> next type matrix, from the bigram counts.
+		Eigen::MatrixXd transition_matrix() const {
+			Eigen::MatrixXd matrix(num_types, num_types);
+			for (int from = 0; from < num_types; from++) {
+				for (int to = 0; to < num_types; to++) {
+					matrix(from, to) = counts[2][from * num_types + to];
+				}
+				double total = matrix.row(from).sum();
+				if (total > 0) {
+					matrix.row(from) /= total;
+				}
+			}
+			return matrix;
+		}
+
+		uint64_t transition_time_count(int from, int to, int bin) const {
+			return transition_times[((size_t)from * num_types + to) * num_bins + bin];
+		}
+
+		//Lower edge of a time bin, in seconds (the first bin also holds everything shorter).
+		REAL bin_edge(int bin) const {
+			return min_gap * std::pow(max_gap / min_gap, (REAL)bin / num_bins);
+		}
+
+		int num_types, order, num_bins;
+		REAL min_gap, max_gap;
+
+	private:
+		int bin(REAL gap) const {
+			if (!(gap > min_gap)) {
+				return 0;
+			}
+			int b = std::log(gap / min_gap) / std::log(max_gap / min_gap) * num_bins;
+			return std::min(b, num_bins - 1);
+		}
+
+		std::vector<std::vector<uint64_t>> counts;
+		std::vector<int> history;
+		std::vector<uint64_t> transition_times;
+		REAL last_time = 0;
+		long seen = 0;
+};
+
+//SequenceStatistics per instrument, plus one over the interleaved stream of all of them.
+struct InstrumentSequences {
+	SequenceStatistics all;
+	std::map<std::string, SequenceStatistics, std::less<>> instruments;
+
+	void break_sequence() {
+		all.break_sequence();
+		for (auto& [instrument, statistics] : instruments) {
+			statistics.break_sequence();
+		}
+	}
+
+	void merge(const InstrumentSequences& other) {
+		all.merge(other.all);
+		for (const auto& [instrument, statistics] : other.instruments) {
+			auto found = instruments.find(instrument);
+			if (found == instruments.end()) {
+				instruments.emplace(instrument, statistics);
+			} else {
+				found->second.merge(statistics);
+			}
+		}
+	}
+};
+
+//Adds one session CSV to sequences, reading only the instrument, time and type of each line (see parse_record_key).
+void accumulate_sequences(const std::string& filename, InstrumentSequences& sequences) {
+	std::ifstream file(filename);
+	std::string line;
+	if (!std::getline(file, line)) {
+		std::cerr << "could not read " << filename << std::endl;
+		return;
+	}
+	sequences.break_sequence();
+	std::string_view instrument;
+	REAL time;
+	int event_type;
+	std::string last_instrument;
+	SequenceStatistics* current = nullptr;
+	while (std::getline(file, line)) {
+		if (!parse_record_key(line, instrument, time, event_type)) {
+			continue;
+		}
+		if (!current || instrument != last_instrument) {
+			last_instrument = instrument;
+			auto found = sequences.instruments.find(instrument);
+			if (found == sequences.instruments.end()) {
+				const SequenceStatistics& all = sequences.all;
+				found = sequences.instruments.emplace(last_instrument, SequenceStatistics(all.num_types, all.order, all.num_bins, all.min_gap, all.max_gap)).first;
+			}
+			current = &found->second;
+		}
+		sequences.all.observe(event_type, time);
+		current->observe(event_type, time);
+	}
+}
+
+/*
+ * Runs accumulate_sequences over many session files on num_threads threads, each with its own tables, and merges
+ * them at the end. prototype only fixes the order and binning; its counts are not included.
+ */
+InstrumentSequences run_sequence_statistics(const std::vector<std::string>& filenames, const SequenceStatistics& prototype=SequenceStatistics(), int num_threads=std::thread::hardware_concurrency()) {
+	SequenceStatistics empty(prototype.num_types, prototype.order, prototype.num_bins, prototype.min_gap, prototype.max_gap);
+	InstrumentSequences total{empty, {}};
+	std::mutex total_mutex;
+	std::atomic<size_t> next_session(0);
+
+	auto worker = [&]() {
+		InstrumentSequences local{empty, {}};
+		for (size_t i = next_session++; i < filenames.size(); i = next_session++) {
+			accumulate_sequences(filenames[i], local);
+		}
+		std::lock_guard<std::mutex> lock(total_mutex);
+		total.merge(local);
+	};
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < std::max(num_threads, 1); t++) {
+		threads.emplace_back(worker);
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	return total;
+}
+
+#endif //SEQUENCES_H
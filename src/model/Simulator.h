@@ -0,0 +1,266 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <vector>
+#include <map>
+#include <random>
+#include <cmath>
+#include <algorithm>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+#include "Kernel.h"
+#include "Book.h"
+#include "IntensityGrid.h"
+
+//Walker's alias method: O(1) draws from a fixed discrete distribution.
+class AliasTable {
+	public:
+		AliasTable(const std::vector<double>& weights) : probability(weights.size()), alias(weights.size()) {
+			int n = weights.size();
+			double total = 0;
+			for (double weight : weights) {
+				total += weight;
+			}
+			std::vector<double> scaled(n);
+			std::vector<int> small, large;
+			for (int i = 0; i < n; i++) {
+				scaled[i] = weights[i] * n / total;
+				(scaled[i] < 1 ? small : large).push_back(i);
+			}
+			while (!small.empty() && !large.empty()) {
+				int s = small.back(), l = large.back();
+				small.pop_back();
+				probability[s] = scaled[s];
+				alias[s] = l;
+				scaled[l] -= 1 - scaled[s];
+				if (scaled[l] < 1) {
+					large.pop_back();
+					small.push_back(l);
+				}
+			}
+			for (int i : small) {
+				probability[i] = 1;
+			}
+			for (int i : large) {
+				probability[i] = 1;
+			}
+		}
+
+		template <class Generator>
+		int sample(Generator& rng) const {
+			double u = std::uniform_real_distribution<double>(0, probability.size())(rng);
+			int i = std::min((int)u, (int)probability.size() - 1);
+			return u - i < probability[i] ? i : alias[i];
+		}
+
+	private:
+		std::vector<double> probability;
+		std::vector<int> alias;
+};
+
+//Integer-valued empirical distribution, built from observed counts; a single value if nothing was observed.
+class EmpiricalDistribution {
+	public:
+		EmpiricalDistribution(const std::map<long, double>& counts, long default_value) : table(weights(counts)) {
+			for (const auto& [value, count] : counts) {
+				values.push_back(value);
+			}
+			if (values.empty()) {
+				values.push_back(default_value);
+			}
+		}
+
+		template <class Generator>
+		long sample(Generator& rng) const {
+			return values[table.sample(rng)];
+		}
+
+	private:
+		static std::vector<double> weights(const std::map<long, double>& counts) {
+			std::vector<double> result;
+			for (const auto& [value, count] : counts) {
+				result.push_back(count);
+			}
+			return result.empty() ? std::vector<double>{1.0} : result;
+		}
+
+		std::vector<long> values;
+		AliasTable table;
+};
+
+/*
+ * Per event type, the empirical distributions of order size and of price offset in ticks from the same side's touch
+ * before the event (positive is deeper in the book, negative improves it).
+ * observe() takes events in order, using the previous event's BBO marks as the book the order arrived to, and needs
+ * the ORDER_SIZE and ORDER_PRICE marks.
+ */
+class OrderFlowDistributions {
+	public:
+		OrderFlowDistributions(int num_event_types, REAL tick_size) : tick_size(tick_size), size_counts(num_event_types), offset_counts(num_event_types) {}
+
+		void observe(const Event& event) {
+			if (event.marks.size() > ORDER_PRICE && previous_marks.size() > ASK_PRICE) {
+				BookSide side = event_side(event.event_type);
+				double touch = previous_marks[side == BID ? BID_PRICE : ASK_PRICE];
+				if (!std::isnan(touch)) {
+					double offset = (event.marks[ORDER_PRICE] - touch) / tick_size;
+					offset_counts[event.event_type][std::lround(side == BID ? -offset : offset)] += 1;
+				}
+				size_counts[event.event_type][std::lround(event.marks[ORDER_SIZE])] += 1;
+			}
+			previous_marks = event.marks;
+		}
+
+		template <class EventRange>
+		void fit(EventRange& events) {
+			for (const auto& event : events) {
+				observe(event_ref(event));
+			}
+		}
+
+		EmpiricalDistribution size_distribution(int event_type) const {
+			return EmpiricalDistribution(size_counts[event_type], 1);
+		}
+
+		EmpiricalDistribution offset_distribution(int event_type) const {
+			return EmpiricalDistribution(offset_counts[event_type], 0);
+		}
+
+		REAL tick_size;
+
+	private:
+		std::vector<std::map<long, double>> size_counts, offset_counts;
+		Eigen::VectorXd previous_marks;
+};
+
+/*
+ * Simulates order flow from a fitted kernel onto an L2Book.
+ * Event times and types come from Ogata thinning against the kernel's get_intensity_upper_bound(); each event is
+ * turned into a book change with sizes and offsets drawn from the fitted OrderFlowDistributions, and is then handed
+ * to the kernel with the new BBO (and the order) as its marks, so state-dependent kernels see the simulated book.
+ * Adds never cross the book. Trades take size from the touch opposite the aggressor; fills carry no book change, as
+ * in the feed. Modifies are a cancel at a cancel-distributed level plus an add at a modify-distributed one.
+ * The event, offsets and intensity buffers are reused, so a step only allocates what the kernel's update does.
+ */
+class BookSimulator {
+	public:
+		BookSimulator(Kernel& kernel, L2Book& book, const OrderFlowDistributions& distributions, unsigned long seed=0) : kernel(kernel), book(book), rng(seed), event(kernel.current_time, 0, Eigen::VectorXd::Constant(NUM_BOOK_MARKS, NAN), 1.0), offsets(1), intensities(1, kernel.num_event_types) {
+			for (int type = 0; type < kernel.num_event_types; type++) {
+				sizes.push_back(distributions.size_distribution(type));
+				price_offsets.push_back(distributions.offset_distribution(type));
+			}
+		}
+
+		//Simulates and applies the next event; false once the kernel's end_time is reached or every intensity is zero.
+		bool step() {
+			REAL bound = kernel.get_intensity_upper_bound();
+			if (!(bound > 0)) {
+				return false;
+			}
+			std::exponential_distribution<double> waiting((double)bound);
+			std::uniform_real_distribution<double> uniform(0.0, 1.0);
+			REAL offset = 0;
+			double total;
+			while (true) {
+				offset += waiting(rng);
+				if (kernel.current_time + offset > kernel.end_time) {
+					return false;
+				}
+				offsets[0] = offset;
+				kernel.get_intensities_at(offsets, intensities);
+				total = intensities.sum();
+				if (uniform(rng) * bound <= total) {
+					break;
+				}
+			}
+
+			double target = uniform(rng) * total;
+			int type = 0;
+			while (type < kernel.num_event_types - 1 && (target -= intensities(0, type)) > 0) {
+				type++;
+			}
+
+			event.time = kernel.current_time + offset;
+			event.event_type = type;
+			apply(type);
+			book.write_marks(event.marks);
+			kernel.update(event);
+			return true;
+		}
+
+		//Runs until end_time or max_events; returns the number of events simulated.
+		long run(long max_events) {
+			long count = 0;
+			while (count < max_events && step()) {
+				count++;
+			}
+			return count;
+		}
+
+		const Event& last_event() const {
+			return event;
+		}
+
+	private:
+		//Tick offset from the touch, deeper for positive offsets, never crossing the other side.
+		long place(BookSide side, long offset) {
+			long tick = side == BID ? book.touch(BID) - offset : book.touch(ASK) + offset;
+			BookSide other = side == BID ? ASK : BID;
+			if (!book.empty(other)) {
+				tick = side == BID ? std::min(tick, book.best(ASK) - 1) : std::max(tick, book.best(BID) + 1);
+			}
+			return tick;
+		}
+
+		void cancel(BookSide side, int type, double size) {
+			if (book.empty(side)) {
+				return;
+			}
+			long tick = place(side, std::max(0L, price_offsets[type].sample(rng)));
+			if (book.remove(side, tick, size) == 0) {
+				book.remove(side, book.best(side), size);
+			}
+		}
+
+		void apply(int type) {
+			BookSide side = event_side(type);
+			double size = std::max(1L, sizes[type].sample(rng));
+			long tick = 0;
+			switch (event_action(type)) {
+				case ADD:
+					tick = place(side, price_offsets[type].sample(rng));
+					book.add(side, tick, size);
+					break;
+				case CANCEL:
+					cancel(side, type, size);
+					tick = book.touch(side);
+					break;
+				case MODIFY:
+					cancel(side, make_event_type(CANCEL, side), size);
+					tick = place(side, price_offsets[type].sample(rng));
+					book.add(side, tick, size);
+					break;
+				case TRADE:
+					tick = book.touch(side == BID ? ASK : BID);
+					book.take(side == BID ? ASK : BID, size);
+					break;
+				default:
+					tick = book.touch(side);
+					break;
+			}
+			event.marks[ORDER_SIZE] = size;
+			event.marks[ORDER_PRICE] = book.to_price(tick);
+		}
+
+		Kernel& kernel;
+		L2Book& book;
+		std::mt19937_64 rng;
+		Event event;
+		Eigen::VectorXd offsets;
+		Eigen::MatrixXd intensities;
+		std::vector<EmpiricalDistribution> sizes, price_offsets;
+};
+
+#endif //SIMULATOR_H
@@ -0,0 +1,192 @@
+#ifndef SORTING_H
+#define SORTING_H
+
+#include <string>
+#include <string_view>
+#include <functional>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+#include "Types.h"
+
+//Runs body(t) for t in [0, num_threads) on that many threads and waits for all of them.
+template <class Body>
+void run_on_threads(int num_threads, Body body) {
+	std::vector<std::thread> threads;
+	for (int t = 1; t < num_threads; t++) {
+		threads.emplace_back(body, t);
+	}
+	body(0);
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+}
+
+/*
+ * Stable LSD radix sort of keys, carrying values along, one byte per pass.
+ * Each pass histograms the thread's contiguous chunk, turns the per-thread histograms into per-thread output offsets
+ * (digit-major, then thread order, which keeps the sort stable) and scatters each chunk independently. Passes where
+ * every key has the same byte, such as the high bytes of timestamps from one day, are skipped.
+ */
+void radix_sort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values, int num_threads=std::thread::hardware_concurrency()) {
+	size_t n = keys.size();
+	num_threads = std::max(1, std::min<int>(num_threads, n / 65536 + 1));
+	std::vector<uint64_t> key_buffer(n);
+	std::vector<uint32_t> value_buffer(n);
+	std::vector<size_t> counts((size_t)num_threads * 256);
+	auto chunk_start = [&](int t) {
+		return n * t / num_threads;
+	};
+
+	for (int shift = 0; shift < 64; shift += 8) {
+		std::fill(counts.begin(), counts.end(), 0);
+		run_on_threads(num_threads, [&](int t) {
+			size_t* local = &counts[(size_t)t * 256];
+			for (size_t i = chunk_start(t); i < chunk_start(t + 1); i++) {
+				local[(keys[i] >> shift) & 0xff]++;
+			}
+		});
+
+		bool trivial = false;
+		size_t running = 0;
+		for (int digit = 0; digit < 256; digit++) {
+			size_t total = 0;
+			for (int t = 0; t < num_threads; t++) {
+				size_t count = counts[(size_t)t * 256 + digit];
+				counts[(size_t)t * 256 + digit] = running;
+				running += count;
+				total += count;
+			}
+			trivial = trivial || total == n;
+		}
+		if (trivial) {
+			continue;
+		}
+
+		run_on_threads(num_threads, [&](int t) {
+			size_t* offsets = &counts[(size_t)t * 256];
+			for (size_t i = chunk_start(t); i < chunk_start(t + 1); i++) {
+				size_t destination = offsets[(keys[i] >> shift) & 0xff]++;
+				key_buffer[destination] = keys[i];
+				value_buffer[destination] = values[i];
+			}
+		});
+		keys.swap(key_buffer);
+		values.swap(value_buffer);
+	}
+}
+
+//Maps a double to an unsigned integer with the same order, so times sort exactly however large or fine they are.
+inline uint64_t ordered_bits(double value) {
+	uint64_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return bits & 0x8000000000000000ull ? ~bits : bits | 0x8000000000000000ull;
+}
+
+enum SortKey {
+	//Event time, as Parse.h reads it (ts_event); ties keep their file order.
+	BY_EVENT_TIME,
+	//Event time plus the feed's ts_delta, which recovers the receive order the file was interleaved in.
+	BY_RECEIVE_TIME
+};
+
+struct SortReport {
+	size_t num_events = 0;
+	//Adjacent pairs that were out of order in the input, and the largest step back in time among them.
+	size_t num_inversions = 0;
+	REAL max_backward_step = 0;
+	//Events that ended up somewhere else, and identical records dropped.
+	size_t num_moved = 0;
+	size_t num_duplicates = 0;
+
+	void print(std::ostream& os) const {
+		os << num_events << " events: " << num_inversions << " inversions (largest " << max_backward_step << "), " << num_moved << " moved, " << num_duplicates << " duplicates removed" << std::endl;
+	}
+};
+
+//64-bit FNV-1a hash of a record's CSV line, so sort_events can find repeated records without holding the lines.
+inline uint64_t line_hash(std::string_view line) {
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (char c : line) {
+		hash = (hash ^ (unsigned char)c) * 0x100000001b3ull;
+	}
+	return hash;
+}
+
+/*
+ * Sorts a session's events by key in place with radix_sort, so that the timediff recursions in Kernel::update
+ * never see time go backwards. receive_deltas, needed for BY_RECEIVE_TIME, holds each event's ts_delta in the same
+ * units as time (EventIterator does not keep it on the Event); without one per event nothing is sorted. Costs one
+ * 12-byte key/index pair and one moved Event per record.
+ * Nothing is dropped unless line_hashes (line_hash of each event's CSV line) is given, in which case an event whose
+ * line equals an earlier one with the same key is removed. Equal hashes are confirmed against source_line(i), which
+ * returns event i's line (e.g. from a MappedFile at a recorded offset), so only colliding lines are ever read; without
+ * it equal hashes are taken as equal lines. The Event alone cannot tell a repeated message from, say, several equal
+ * fills of a sweep, which share the time, price, size and BBO but are distinct.
+ */
+SortReport sort_events(std::vector<Event>& events, SortKey key=BY_EVENT_TIME, const std::vector<double>& receive_deltas={}, const std::vector<uint64_t>& line_hashes={}, const std::function<std::string_view(size_t)>& source_line=nullptr, int num_threads=std::thread::hardware_concurrency()) {
+	SortReport report;
+	size_t n = events.size();
+	report.num_events = n;
+	if (key == BY_RECEIVE_TIME && receive_deltas.size() != n) {
+		std::cerr << "sort_events: " << receive_deltas.size() << " receive deltas for " << n << " events, not sorting" << std::endl;
+		return report;
+	}
+	std::vector<uint64_t> keys(n);
+	std::vector<uint32_t> order(n);
+	double previous = -INFINITY;
+	for (size_t i = 0; i < n; i++) {
+		double time = events[i].time;
+		if (key == BY_RECEIVE_TIME) {
+			time += receive_deltas[i];
+		}
+		keys[i] = ordered_bits(time);
+		order[i] = i;
+		if (time < previous) {
+			report.num_inversions++;
+			report.max_backward_step = std::max<REAL>(report.max_backward_step, previous - time);
+		}
+		previous = time;
+	}
+	if (report.num_inversions > 0) {
+		radix_sort(keys, order, num_threads);
+	}
+
+	bool deduplicate = line_hashes.size() == n;
+	if (!line_hashes.empty() && !deduplicate) {
+		std::cerr << "sort_events: " << line_hashes.size() << " line hashes for " << n << " events, not deduplicating" << std::endl;
+	}
+	std::vector<Event> sorted;
+	std::vector<uint32_t> kept;
+	sorted.reserve(n);
+	size_t run_start = 0;
+	for (size_t i = 0; i < n; i++) {
+		Event& event = events[order[i]];
+		report.num_moved += order[i] != i;
+		if (i > 0 && keys[i] != keys[i - 1]) {
+			run_start = kept.size();
+		}
+		//Identical lines share a key, so only the (short) run of equal keys needs comparing.
+		bool duplicate = false;
+		for (size_t j = run_start; deduplicate && j < kept.size() && !duplicate; j++) {
+			duplicate = line_hashes[kept[j]] == line_hashes[order[i]] && (!source_line || source_line(kept[j]) == source_line(order[i]));
+		}
+		if (duplicate) {
+			report.num_duplicates++;
+		} else {
+			sorted.push_back(std::move(event));
+			if (deduplicate) {
+				kept.push_back(order[i]);
+			}
+		}
+	}
+	events.swap(sorted);
+	return report;
+}
+
+#endif //SORTING_H
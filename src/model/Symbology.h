@@ -0,0 +1,227 @@
+#ifndef SYMBOLOGY_H
+#define SYMBOLOGY_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "Types.h"
+#include "Parse.h"
+
+// Days since 1970-01-01 of a proleptic Gregorian date.
+long days_from_civil(long year, int month, int day) {
+	year -= month <= 2;
+	long era = (year >= 0 ? year : year - 399) / 400;
+	long year_of_era = year - era * 400;
+	long day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	long day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+	return era * 146097 + day_of_era - 719468;
+}
+
+//A futures contract symbol split into its parts, e.g. ESZ4 is root ES, December, year 2024 (given a reference year).
+struct ContractSymbol {
+	std::string symbol, root;
+	int month = 0, year = 0;
+
+	//Third Friday of the contract month at 13:30 UTC, the CME equity index expiry; NaN if the symbol has no month code.
+	REAL expiry_time() const {
+		if (month == 0) {
+			return NAN;
+		}
+		long first = days_from_civil(year, month, 1);
+		//1970-01-01 was a Thursday, so weekday 0 is Thursday and Friday is 1.
+		long first_friday = first + ((1 - (first % 7 + 7) % 7) + 7) % 7;
+		return (first_friday + 14) * (REAL)seconds_in_day + 13.5 * 3600;
+	}
+};
+
+//Splits root, CME month code and one- or two-digit year, resolving a one-digit year to the decade nearest reference_year.
+ContractSymbol parse_contract_symbol(const std::string& symbol, int reference_year) {
+	static const std::string month_codes = "FGHJKMNQUVXZ";
+	ContractSymbol contract{symbol, symbol};
+	size_t digits = symbol.find_first_of("0123456789");
+	if (digits == std::string::npos || digits < 2 || month_codes.find(symbol[digits - 1]) == std::string::npos) {
+		return contract;
+	}
+	contract.root = symbol.substr(0, digits - 1);
+	contract.month = month_codes.find(symbol[digits - 1]) + 1;
+	int year = std::stoi(symbol.substr(digits));
+	int modulus = symbol.size() - digits == 1 ? 10 : 100;
+	contract.year = reference_year - ((reference_year % modulus - year) % modulus + modulus) % modulus;
+	if (reference_year - contract.year > modulus / 2) {
+		contract.year += modulus;
+	}
+	return contract;
+}
+
+//Which contract of each root is the one to trade over [start_time, end_time), replacing hardcoded roll cutoffs.
+struct RollPeriod {
+	std::string symbol;
+	REAL start_time, end_time;
+};
+
+/*
+ * Roll schedule as a list of periods, read from a CSV of symbol,start,end lines (unix seconds, "inf" allowed), e.g.
+ *	ESU4,0,1726916400
+ *	ESZ4,1726916400,inf
+ * or generated from the expiry rule with quarterly().
+ */
+class RollSchedule {
+	public:
+		RollSchedule() {}
+
+		RollSchedule(const std::string& filename) {
+			std::ifstream file(filename);
+			if (!file) {
+				std::cerr << "could not open roll schedule " << filename << std::endl;
+				return;
+			}
+			std::string line;
+			while (std::getline(file, line)) {
+				std::stringstream stream(line);
+				std::string symbol, start, end;
+				if (line.empty() || line[0] == '#' || !std::getline(stream, symbol, ',') || !std::getline(stream, start, ',') || !std::getline(stream, end, ',')) {
+					continue;
+				}
+				periods.push_back({symbol, std::stold(start), std::stold(end)});
+			}
+		}
+
+		//Quarterly contracts of root from first_year to last_year, each active until days_before_expiry days before its expiry.
+		static RollSchedule quarterly(const std::string& root, int first_year, int last_year, REAL days_before_expiry=8) {
+			static const std::string month_codes = "FGHJKMNQUVXZ";
+			RollSchedule schedule;
+			REAL start = -INFINITY;
+			for (int year = first_year; year <= last_year; year++) {
+				for (int month = 3; month <= 12; month += 3) {
+					ContractSymbol contract{root + month_codes[month - 1] + std::to_string(year % 10), root, month, year};
+					REAL end = contract.expiry_time() - days_before_expiry * seconds_in_day;
+					schedule.periods.push_back({contract.symbol, start, end});
+					start = end;
+				}
+			}
+			return schedule;
+		}
+
+		bool contains(const std::string& symbol, REAL& start_time, REAL& end_time) const {
+			for (const RollPeriod& period : periods) {
+				if (period.symbol == symbol) {
+					start_time = period.start_time;
+					end_time = period.end_time;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		std::vector<RollPeriod> periods;
+};
+
+struct InstrumentInfo {
+	ContractSymbol contract;
+	REAL expiry;
+	//When this instrument id is both mapped to the symbol and the scheduled contract; empty if it never is.
+	REAL valid_from, valid_to;
+};
+
+/*
+ * Flat instrument_id -> contract table for one data file, built once from the file's symbol mappings and a roll
+ * schedule, so the per-message filter is a hashed array lookup and a timestamp compare instead of a symbology resolve.
+ * The mappings are a CSV of instrument_id,symbol,start,end lines (unix seconds), as written per file by
+ * databento_parse.write_symbology; an id mapped to several symbols over the file keeps the scheduled one.
+ */
+class SymbologyTable {
+	public:
+		SymbologyTable(const std::string& mappings_filename, const RollSchedule& schedule, int reference_year) {
+			std::ifstream file(mappings_filename);
+			if (!file) {
+				std::cerr << "could not open symbology " << mappings_filename << std::endl;
+				return;
+			}
+			struct Mapping {
+				uint32_t instrument_id;
+				std::string symbol;
+				REAL start, end;
+			};
+			std::vector<Mapping> mappings;
+			std::string line;
+			while (std::getline(file, line)) {
+				std::stringstream stream(line);
+				std::string id, symbol, start, end;
+				if (!std::getline(stream, id, ',') || !std::getline(stream, symbol, ',') || !std::getline(stream, start, ',') || !std::getline(stream, end, ',') || id.find_first_not_of("0123456789") != std::string::npos) {
+					continue;
+				}
+				mappings.push_back({(uint32_t)std::stoul(id), symbol, std::stold(start), std::stold(end)});
+			}
+			if (mappings.empty()) {
+				return;
+			}
+			//Open addressing at load factor at most a half, since CME ids in one file can span tens of millions.
+			size_t capacity = 1;
+			while (capacity < 2 * mappings.size()) {
+				capacity *= 2;
+			}
+			keys.assign(capacity, 0);
+			slots.assign(capacity, -1);
+			for (const Mapping& mapping : mappings) {
+				REAL scheduled_start, scheduled_end;
+				bool scheduled = schedule.contains(mapping.symbol, scheduled_start, scheduled_end);
+				size_t position = probe(mapping.instrument_id);
+				keys[position] = mapping.instrument_id;
+				int32_t& slot = slots[position];
+				if (slot >= 0 && !(scheduled && instruments[slot].valid_to <= instruments[slot].valid_from)) {
+					continue;
+				}
+				ContractSymbol contract = parse_contract_symbol(mapping.symbol, reference_year);
+				InstrumentInfo info{contract, contract.expiry_time(), 0, 0};
+				if (scheduled) {
+					info.valid_from = std::max(mapping.start, scheduled_start);
+					info.valid_to = std::min(mapping.end, scheduled_end);
+				}
+				if (slot >= 0) {
+					instruments[slot] = info;
+				} else {
+					slot = instruments.size();
+					instruments.push_back(info);
+				}
+			}
+		}
+
+		//The instrument, or nullptr if the id is not in the file.
+		const InstrumentInfo* find(uint32_t instrument_id) const {
+			if (slots.empty()) {
+				return nullptr;
+			}
+			int32_t slot = slots[probe(instrument_id)];
+			return slot < 0 ? nullptr : &instruments[slot];
+		}
+
+		//The instrument if it is the scheduled contract at time, else nullptr.
+		const InstrumentInfo* active(uint32_t instrument_id, REAL time) const {
+			const InstrumentInfo* info = find(instrument_id);
+			return info && info->valid_from <= time && time < info->valid_to ? info : nullptr;
+		}
+
+		std::vector<InstrumentInfo> instruments;
+
+	private:
+		//Position of instrument_id in keys, or of the empty entry where it would go.
+		size_t probe(uint32_t instrument_id) const {
+			size_t mask = slots.size() - 1;
+			size_t position = (instrument_id * 2654435761u) & mask;
+			while (slots[position] >= 0 && keys[position] != instrument_id) {
+				position = (position + 1) & mask;
+			}
+			return position;
+		}
+
+		std::vector<uint32_t> keys;
+		std::vector<int32_t> slots;
+};
+
+#endif //SYMBOLOGY_H
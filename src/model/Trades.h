@@ -0,0 +1,162 @@
+#ifndef TRADES_H
+#define TRADES_H
+
+#include <iostream>
+#include <cmath>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+
+//One aggressor order's match: everything it traded in one exchange event.
+struct ClassifiedTrade {
+	REAL time;
+	BookSide aggressor;
+	double size;
+	//Price of the first and furthest level it traded at, and how many distinct levels that was, from the trade and
+	//fill prices (the feed may send one trade for a sweep with fills at each level).
+	double first_price, last_price;
+	int levels;
+	//Resting-side fills and cancels reported for the match, which should both equal size.
+	double filled, cancelled;
+};
+
+//Inconsistencies found so far, as counts of exchange events.
+struct ReconciliationCounters {
+	long trades = 0;
+	//Trade size differs from the resting fills reported with it.
+	long fill_mismatches = 0;
+	//Fills with no trade message in the same exchange event (the aggressor is then inferred from the fill side).
+	long orphan_fills = 0;
+	//Resting cancels at the traded levels differ from the traded size.
+	long cancel_mismatches = 0;
+	//The trade's side disagrees with where its first price sat against the BBO before the match.
+	long side_disagreements = 0;
+	//Exchange events with trades on both sides; only the first trade's side is kept.
+	long mixed_sides = 0;
+
+	void print(std::ostream& os) const {
+		os << trades << " trades: " << fill_mismatches << " fill mismatches, " << orphan_fills << " orphan fills, " << cancel_mismatches << " cancel mismatches, " << side_disagreements << " side disagreements, " << mixed_sides << " mixed sides" << std::endl;
+	}
+};
+
+/*
+ * Matches trades to their resting fills and cancels as messages stream past, alongside book reconstruction.
+ * Messages of one exchange event share a ts_event (see Packets.h), so the only state is the current event's running
+ * totals and the BBO before it; observe() is O(1) per message and never allocates. A trade is classified when its
+ * exchange event closes, i.e. on the first message with a later time (or on flush()), by the side of the trade
+ * message, which in this feed is the aggressor's, and is cross-checked against the prior BBO.
+ */
+class TradeReconciler {
+	public:
+		//Feeds one message; true if it closed an exchange event that traded, which is then in last_trade().
+		bool observe(const Event& event) {
+			bool closed = false;
+			if (open && event.time != current.time) {
+				closed = close();
+			}
+			if (!open) {
+				begin(event.time);
+			}
+			OrderAction action = event_action(event.event_type);
+			BookSide side = event_side(event.event_type);
+			if (event.marks.size() > ORDER_PRICE) {
+				double size = event.marks[ORDER_SIZE], price = event.marks[ORDER_PRICE];
+				if (action == TRADE) {
+					add_trade(side, size, price);
+				} else if (action == FILL && !(traded_any && side == current.aggressor)) {
+					//Fills on the aggressor's own side belong to an opposite trade in a mixed event.
+					fill_side = side;
+					current.filled += size;
+					extend_sweep(price);
+				} else if (action == CANCEL && traded_any && side != current.aggressor && within_sweep(price)) {
+					current.cancelled += size;
+				}
+			}
+			closing_bid = event.marks.size() > ASK_PRICE ? event.marks[BID_PRICE] : NAN;
+			closing_ask = event.marks.size() > ASK_PRICE ? event.marks[ASK_PRICE] : NAN;
+			return closed;
+		}
+
+		//Closes the last exchange event at the end of the stream; true if it traded.
+		bool flush() {
+			return open && close();
+		}
+
+		const ClassifiedTrade& last_trade() const {
+			return trade;
+		}
+
+		ReconciliationCounters counters;
+
+	private:
+		void begin(REAL time) {
+			open = true;
+			traded_any = false;
+			fill_side = -1;
+			current = ClassifiedTrade{time, BID, 0, NAN, NAN, 0, 0, 0};
+			event_bid = closing_bid;
+			event_ask = closing_ask;
+		}
+
+		void add_trade(BookSide side, double size, double price) {
+			if (!traded_any) {
+				traded_any = true;
+				current.aggressor = side;
+			} else if (side != current.aggressor) {
+				mixed = true;
+				return;
+			}
+			extend_sweep(price);
+			current.size += size;
+		}
+
+		//A sweep only moves away from its first price, so a price outside the range so far is a new level.
+		void extend_sweep(double price) {
+			if (current.levels == 0) {
+				current.first_price = price;
+				current.last_price = price;
+				current.levels = 1;
+			} else if (!within_sweep(price)) {
+				current.last_price = price;
+				current.levels++;
+			}
+		}
+
+		bool within_sweep(double price) const {
+			double low = std::min(current.first_price, current.last_price), high = std::max(current.first_price, current.last_price);
+			return price >= low && price <= high;
+		}
+
+		bool close() {
+			open = false;
+			if (!traded_any && fill_side < 0) {
+				return false;
+			}
+			if (!traded_any) {
+				//Fills without their trade message: the aggressor is the other side of the resting orders.
+				counters.orphan_fills++;
+				current.aggressor = fill_side == BID ? ASK : BID;
+				current.size = current.filled;
+			}
+			counters.trades++;
+			counters.fill_mismatches += traded_any && current.filled != current.size;
+			counters.cancel_mismatches += traded_any && current.cancelled != current.size;
+			counters.mixed_sides += mixed;
+			mixed = false;
+			if (traded_any && !std::isnan(event_bid) && !std::isnan(event_ask)) {
+				bool buyer = current.first_price >= event_ask, seller = current.first_price <= event_bid;
+				counters.side_disagreements += (current.aggressor == BID && seller && !buyer) || (current.aggressor == ASK && buyer && !seller);
+			}
+			trade = current;
+			return true;
+		}
+
+		bool open = false, traded_any = false, mixed = false;
+		int fill_side = -1;
+		ClassifiedTrade current{0, BID, 0, NAN, NAN, 0, 0, 0}, trade{0, BID, 0, NAN, NAN, 0, 0, 0};
+		//BBO before the current exchange event, and after the latest message.
+		double event_bid = NAN, event_ask = NAN, closing_bid = NAN, closing_ask = NAN;
+};
+
+#endif //TRADES_H
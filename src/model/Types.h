@@ -9,6 +9,45 @@
 #define MATRIX Eigen::MatrixXd
 #define GENERATOR Realisation
 
+// Layout of Event::marks: the aggregated BBO columns of the CSV after the event, then the event's own order.
+enum BookMark {
+	BID_SIZE = 0,
+	BID_PRICE = 1,
+	ASK_SIZE = 2,
+	ASK_PRICE = 3,
+	ORDER_SIZE = 4,
+	ORDER_PRICE = 5,
+	NUM_BOOK_MARKS = 6
+};
+
+// Parse.h encodes event_type as action * 2 + side, so types 2..11 cover every (action, side) pair.
+enum OrderAction {
+	ADD = 1,
+	CANCEL = 2,
+	MODIFY = 3,
+	TRADE = 4,
+	FILL = 5
+};
+
+enum BookSide {
+	BID = 0,
+	ASK = 1
+};
+
+const int num_order_event_types = 12;
+
+inline OrderAction event_action(int event_type) {
+	return (OrderAction)(event_type / 2);
+}
+
+inline BookSide event_side(int event_type) {
+	return (BookSide)(event_type % 2);
+}
+
+inline int make_event_type(OrderAction action, BookSide side) {
+	return action * 2 + side;
+}
+
 struct Event {
 	REAL time;
 	int event_type;
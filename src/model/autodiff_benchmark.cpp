@@ -0,0 +1,106 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+#include "Kernel.h"
+#include "AutodiffKernel.h"
+#include "BatchLikelihood.h"
+
+// Compares the hand-written PoissonKernel pass against the same model differentiated by AutodiffPoissonKernel, and the
+// hand-written value and gradient of BatchExpHawkesLikelihood (one candidate) against AutodiffExpHawkesKernel.
+// g++ -O3 -DNDEBUG -I $EIGEN_PATH autodiff_benchmark.cpp
+template <class K>
+double time_pass(K& kernel, const std::vector<Event>& events) {
+	auto start = std::chrono::steady_clock::now();
+	kernel.reset();
+	for (const Event& event : events) {
+		kernel.update(event);
+	}
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::nano>(end - start).count() / events.size();
+}
+
+int main() {
+	std::cout << std::setprecision(6);
+
+	const int num_event_types = 12;
+	const int num_events = 5000000;
+	const REAL end_time = 60*60*8;
+
+	std::mt19937 rng(0);
+	std::uniform_int_distribution<int> type_distribution(0, num_event_types-1);
+	std::vector<Event> events;
+	events.reserve(num_events);
+	for (int i = 0; i < num_events; i++) {
+		events.emplace_back(end_time * i / num_events, type_distribution(rng), Eigen::VectorXd(), 1.0);
+	}
+
+	PoissonKernel hand_written(num_event_types, 0, end_time);
+	AutodiffPoissonKernel autodiff(num_event_types, 0, end_time);
+	autodiff.set_params(hand_written.get_params());
+
+	double hand_written_ns = time_pass(hand_written, events);
+	double autodiff_ns = time_pass(autodiff, events);
+
+	auto [hess, grad] = hand_written.get_hessian_and_gradient();
+	auto [ad_hess, ad_grad] = autodiff.get_hessian_and_gradient();
+
+	std::cout << "hand-written: " << hand_written_ns << " ns/event" << std::endl;
+	std::cout << "autodiff:     " << autodiff_ns << " ns/event (" << autodiff_ns / hand_written_ns << "x)" << std::endl;
+	std::cout << "max relative gradient difference: " << ((grad - ad_grad).cwiseAbs().array() / grad.cwiseAbs().array().max(1.0)).maxCoeff() << std::endl;
+	std::cout << "max relative hessian difference:  " << ((hess - ad_hess).cwiseAbs().array() / hess.cwiseAbs().array().max(1.0)).maxCoeff() << std::endl;
+
+	//Exponential Hawkes: each block carries 1 + 2D parameters, so the autodiff pass also pays for a (1 + 2D)^2 Hessian.
+	const int D = 4;
+	const int num_hawkes_events = 500000;
+	const REAL hawkes_end_time = 60*60;
+	std::uniform_int_distribution<int> hawkes_type_distribution(0, D-1);
+	std::vector<Event> hawkes_events;
+	hawkes_events.reserve(num_hawkes_events);
+	for (int i = 0; i < num_hawkes_events; i++) {
+		hawkes_events.emplace_back(hawkes_end_time * i / num_hawkes_events, hawkes_type_distribution(rng), Eigen::VectorXd(), 1.0);
+	}
+
+	AutodiffExpHawkesKernel<D> hawkes(0, hawkes_end_time);
+	BatchExpHawkesLikelihood batch(D, 0, hawkes_end_time, hawkes.get_params(), true);
+
+	double batch_ns = time_pass(batch, hawkes_events);
+	double hawkes_ns = time_pass(hawkes, hawkes_events);
+
+	double batch_log_likelihood = batch.get_log_likelihoods()[0];
+	Eigen::VectorXd batch_grad = batch.get_gradients().col(0);
+	auto [hawkes_hess, hawkes_grad] = hawkes.get_structured_hessian_and_gradient();
+
+	std::cout << "exp hawkes hand-written value and gradient: " << batch_ns << " ns/event" << std::endl;
+	std::cout << "exp hawkes autodiff:     " << hawkes_ns << " ns/event (" << hawkes_ns / batch_ns << "x)" << std::endl;
+	std::cout << "relative log-likelihood difference: " << std::abs((double)(hawkes.get_log_likelihood() - batch_log_likelihood)) / std::abs(batch_log_likelihood) << std::endl;
+	std::cout << "max relative gradient difference: " << ((batch_grad - hawkes_grad).cwiseAbs().array() / batch_grad.cwiseAbs().array().max(1.0)).maxCoeff() << std::endl;
+
+	//Central differences of the hand-written gradient, with every perturbed parameter vector a candidate of one pass.
+	Eigen::VectorXd params = hawkes.get_params();
+	int num_params = params.size();
+	Eigen::MatrixXd perturbed = params.replicate(1, 2 * num_params);
+	Eigen::VectorXd steps = 1e-5 * params.cwiseAbs().cwiseMax(1.0);
+	for (int p = 0; p < num_params; p++) {
+		perturbed(p, 2 * p) += steps[p];
+		perturbed(p, 2 * p + 1) -= steps[p];
+	}
+	BatchExpHawkesLikelihood differences(D, 0, hawkes_end_time, perturbed, true);
+	for (const Event& event : hawkes_events) {
+		differences.update(event);
+	}
+	Eigen::MatrixXd perturbed_grads = differences.get_gradients();
+	Eigen::MatrixXd numeric_hess(num_params, num_params);
+	for (int p = 0; p < num_params; p++) {
+		numeric_hess.col(p) = (perturbed_grads.col(2 * p) - perturbed_grads.col(2 * p + 1)) / (2 * steps[p]);
+	}
+	Eigen::MatrixXd dense_hawkes_hess = hawkes_hess.to_dense();
+	std::cout << "max relative hessian difference against central differences: " << ((numeric_hess - dense_hawkes_hess).cwiseAbs().array() / numeric_hess.cwiseAbs().array().max(1.0)).maxCoeff() << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,72 @@
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <vector>
+#include <cmath>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+#include "AutodiffKernel.h"
+#include "BatchLikelihood.h"
+
+// Evaluates a few candidate parameter vectors in one BatchExpHawkesLikelihood pass, with and without a seasonal
+// background, and checks each log-likelihood and gradient against its own AutodiffExpHawkesKernel pass.
+// g++ -O2 -I $EIGEN_PATH batch_likelihood_test.cpp && ./a.out
+int main() {
+	std::cout << std::setprecision(6);
+
+	const int D = 2;
+	const int num_candidates = 5;
+	const REAL end_time = 2000;
+
+	std::mt19937 rng(0);
+	std::exponential_distribution<double> gap_distribution(5.0);
+	std::uniform_int_distribution<int> type_distribution(0, D-1);
+	std::vector<Event> events;
+	for (REAL time = gap_distribution(rng); time < end_time; time += gap_distribution(rng)) {
+		events.emplace_back(time, type_distribution(rng), Eigen::VectorXd(), 1.0);
+	}
+
+	std::uniform_real_distribution<double> param_distribution(0.1, 3.0);
+	Eigen::MatrixXd candidates(D * (1 + 2 * D), num_candidates);
+	for (int i = 0; i < candidates.size(); i++) {
+		candidates.data()[i] = param_distribution(rng);
+	}
+	SeasonalProfile profile({0, 600, 1400}, (Eigen::MatrixXd(3, D) << 0.5, 1.0, 1.5, 0.8, 1.0, 1.2).finished());
+
+	bool passed = true;
+	for (bool seasonal : {false, true}) {
+		BatchExpHawkesLikelihood batch(D, 0, end_time, candidates, true);
+		if (seasonal) {
+			batch.set_background_profile(profile);
+		}
+		for (const Event& event : events) {
+			batch.update(event);
+		}
+		Eigen::VectorXd log_likelihoods = batch.get_log_likelihoods();
+		Eigen::MatrixXd gradients = batch.get_gradients();
+
+		for (int k = 0; k < num_candidates; k++) {
+			AutodiffExpHawkesKernel<D> kernel(0, end_time);
+			if (seasonal) {
+				kernel.set_background_profile(profile);
+			}
+			kernel.set_params(candidates.col(k));
+			kernel.reset();
+			for (const Event& event : events) {
+				kernel.update(event);
+			}
+			auto [hessian, gradient] = kernel.get_structured_hessian_and_gradient();
+			double value_error = std::abs((double)kernel.get_log_likelihood() - log_likelihoods[k]) / std::abs(log_likelihoods[k]);
+			double gradient_error = ((gradients.col(k) - gradient).cwiseAbs().array() / gradient.cwiseAbs().array().max(1.0)).maxCoeff();
+			std::cout << (seasonal ? "seasonal " : "flat ") << "candidate " << k << " log-likelihood " << log_likelihoods[k] << " relative errors " << value_error << " " << gradient_error << std::endl;
+			if (value_error > 1e-10 || gradient_error > 1e-8) {
+				std::cout << "FAILED" << std::endl;
+				passed = false;
+			}
+		}
+	}
+	std::cout << (passed ? "passed" : "failed") << std::endl;
+	return passed ? 0 : 1;
+}
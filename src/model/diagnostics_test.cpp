@@ -0,0 +1,43 @@
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+#include "Diagnostics.h"
+
+// Checks the Kolmogorov tail probability against tabulated values, and that a near-perfect fit (a tiny KS statistic)
+// reports p close to 1 rather than a rejection.
+// g++ -O2 -I $EIGEN_PATH diagnostics_test.cpp && ./a.out
+int main() {
+	std::cout << std::setprecision(6);
+	bool passed = true;
+
+	const double lambdas[] = {0.01, 0.3, 0.5, 1.0, 1.18, 1.36, 1.63, 2.5};
+	const double expected[] = {1.0, 0.999991, 0.963945, 0.270000, 0.123454, 0.049486, 0.009846, 0.000007};
+	for (int i = 0; i < 8; i++) {
+		double p = kolmogorov_survival(lambdas[i]);
+		std::cout << "lambda=" << lambdas[i] << " p=" << p << " expected " << expected[i] << std::endl;
+		if (std::abs(p - expected[i]) > 1e-5) {
+			std::cout << "FAILED" << std::endl;
+			passed = false;
+		}
+	}
+
+	//Residuals whose u = 1 - exp(-r) land on the bin centres give a statistic of zero at the bin edges.
+	int num_bins = 1000;
+	TimeRescalingDiagnostics diagnostics(1, num_bins);
+	for (int k = 0; k < num_bins; k++) {
+		diagnostics.observe(0, -std::log(1 - (k + 0.5) / num_bins));
+	}
+	REAL p = diagnostics.ks_p_value(0);
+	std::cout << "ks=" << diagnostics.ks_statistic(0) << " p=" << p << std::endl;
+	if (!(p > 0.99)) {
+		std::cout << "FAILED: a near-perfect fit is rejected" << std::endl;
+		passed = false;
+	}
+
+	std::cout << (passed ? "passed" : "failed") << std::endl;
+	return passed ? 0 : 1;
+}
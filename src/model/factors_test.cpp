@@ -0,0 +1,106 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <random>
+#include <vector>
+#include <cmath>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+#include "Binning.h"
+#include "Factors.h"
+
+// Writes three sessions of an AR(1) series, each around a different level, as a binned matrix with its .meta file,
+// streams it through fit_factor_model in blocks that straddle session boundaries, and checks the mean, covariance,
+// lagged covariances (pairs within a session only) and a full-rank PCA against the same quantities computed in one
+// batch from the whole matrix.
+// g++ -O2 -I $EIGEN_PATH factors_test.cpp && ./a.out
+int main() {
+	std::cout << std::setprecision(6);
+
+	const int dimension = 4;
+	const int max_lag = 3;
+	const std::vector<size_t> session_bins = {500, 37, 800};
+	const std::string filename = "factors_test.npy";
+
+	std::mt19937 rng(0);
+	std::normal_distribution<double> noise(0.0, 1.0);
+	Eigen::MatrixXd mixing = Eigen::MatrixXd::Random(dimension, dimension);
+	size_t total_rows = 0;
+	for (size_t bins : session_bins) {
+		total_rows += bins;
+	}
+	Eigen::MatrixXd data(total_rows, dimension);
+	{
+		NpyMatrixFile matrix(filename, total_rows, dimension);
+		std::ofstream meta(filename + ".meta");
+		meta << "columns,a,b,c,d\n";
+		size_t row = 0;
+		for (size_t s = 0; s < session_bins.size(); s++) {
+			meta << "session,day" << s << "," << row << "," << s * seconds_in_day << "," << session_bins[s] << "\n";
+			Eigen::VectorXd level = Eigen::VectorXd::Constant(dimension, 10.0 * s);
+			Eigen::VectorXd state = Eigen::VectorXd::Zero(dimension);
+			for (size_t b = 0; b < session_bins[s]; b++, row++) {
+				Eigen::VectorXd shock(dimension);
+				for (int c = 0; c < dimension; c++) {
+					shock[c] = noise(rng);
+				}
+				state = 0.7 * state + mixing * shock;
+				data.row(row) = (level + state).transpose().cast<float>().cast<double>();
+				for (int c = 0; c < dimension; c++) {
+					matrix.row(row)[c] = data(row, c);
+				}
+			}
+		}
+	}
+
+	StreamingCovariance covariance(dimension, max_lag);
+	StreamingPCA pca(dimension, dimension);
+	fit_factor_model(filename, covariance, pca, 64);
+
+	bool passed = true;
+	auto check = [&](const std::string& name, const Eigen::MatrixXd& streamed, const Eigen::MatrixXd& batch) {
+		double error = (streamed - batch).cwiseAbs().maxCoeff() / std::max(1.0, batch.cwiseAbs().maxCoeff());
+		std::cout << name << " relative error " << error << std::endl;
+		if (error > 1e-9) {
+			std::cout << "FAILED" << std::endl;
+			passed = false;
+		}
+	};
+
+	Eigen::VectorXd mean = data.colwise().mean().transpose();
+	Eigen::MatrixXd centred = data.rowwise() - mean.transpose();
+	Eigen::MatrixXd batch_covariance = centred.transpose() * centred / (total_rows - 1);
+	check("count", Eigen::VectorXd::Constant(1, covariance.count), Eigen::VectorXd::Constant(1, total_rows));
+	check("mean", covariance.mean(), mean);
+	check("covariance", covariance.covariance(), batch_covariance);
+
+	for (int lag = 1; lag <= max_lag; lag++) {
+		std::vector<size_t> current_rows, lagged_rows;
+		size_t first = 0;
+		for (size_t bins : session_bins) {
+			for (size_t t = first + lag; t < first + bins; t++) {
+				current_rows.push_back(t);
+				lagged_rows.push_back(t - lag);
+			}
+			first += bins;
+		}
+		Eigen::MatrixXd current = data(current_rows, Eigen::all), lagged = data(lagged_rows, Eigen::all);
+		double pairs = current_rows.size();
+		Eigen::MatrixXd batch_lagged = current.transpose() * lagged / pairs - current.colwise().mean().transpose() * lagged.colwise().mean();
+		check("lag " + std::to_string(lag) + " covariance", covariance.lagged_covariance(lag), batch_lagged);
+	}
+
+	//At full rank the streamed components are the batch eigenvectors up to sign.
+	Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigen(batch_covariance);
+	Eigen::VectorXd batch_variance = eigen.eigenvalues().reverse();
+	Eigen::MatrixXd batch_components = eigen.eigenvectors().rowwise().reverse().transpose();
+	check("explained variance", pca.explained_variance(), batch_variance);
+	check("components up to sign", (pca.components() * batch_components.transpose()).cwiseAbs(), Eigen::MatrixXd::Identity(dimension, dimension));
+
+	std::remove(filename.c_str());
+	std::remove((filename + ".meta").c_str());
+	std::cout << (passed ? "passed" : "failed") << std::endl;
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,35 @@
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+#include "Book.h"
+#include "Features.h"
+
+// Two trades of opposite sign ten half-lives apart, with a thousand adds between them, must leave the trade-sign EWMA
+// close to the second trade's sign: the first trade decays over the whole gap, not just the last message's.
+// g++ -O2 -I $EIGEN_PATH features_test.cpp && ./a.out
+int main() {
+	std::cout << std::setprecision(10);
+
+	L2Book book(0.25);
+	FeatureExtractor extractor(book, {{TRADE_SIGN_EWMA, 1, 1.0}});
+	Eigen::VectorXd marks = Eigen::VectorXd::Constant(NUM_BOOK_MARKS, NAN);
+
+	const int num_adds = 1000;
+	const double gap = 10;
+	extractor.update(Event(0, make_event_type(TRADE, BID), marks, 1.0));
+	for (int i = 1; i <= num_adds; i++) {
+		extractor.update(Event(gap * i / (num_adds + 1), make_event_type(ADD, i % 2 ? BID : ASK), marks, 1.0));
+	}
+	double value = extractor.update(Event(gap, make_event_type(TRADE, ASK), marks, 1.0))[0];
+
+	double decay = std::exp2(-gap);
+	double expected = (decay - 1) / (decay + 1);
+	std::cout << "trade sign " << value << " expected " << expected << std::endl;
+	bool passed = std::abs(value - expected) < 1e-9;
+	std::cout << (passed ? "passed" : "failed") << std::endl;
+	return passed ? 0 : 1;
+}
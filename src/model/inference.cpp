@@ -8,18 +8,28 @@
 // Example usage
 #include "Parse.h"
 #include "Kernel.h"
+#include "Optimizer.h"
+#include "Bootstrap.h"
+#include "ParameterStore.h"
+#include "Catalog.h"
 int main() {
 	std::cout << std::setprecision(20);
 
-	PoissonKernel kernel(Eigen::VectorXd::Constant(11, 1.0));
-	while (true) {
-		Realisation session("../../output/databento/glbx-mdp3-20240913.csv"); // Replace with your CSV file path
+	std::string path = "../../output/databento/glbx-mdp3-20240913.csv"; // Replace with your CSV file path
+	//Session bounds come from the catalog, so they are known before the first pass and the file is only scanned once.
+	DatasetCatalog catalog("catalog.bin");
+	const CatalogEntry& day = catalog.entry(path);
+
+	PoissonKernel kernel(12, 0, 0);
+	kernel.start_time = day.session_start();
+	kernel.end_time = day.session_end();
+	//One pass over the session per likelihood evaluation; the optimiser resets the kernel before each.
+	auto pass = [&](Kernel& kernel) {
+		Realisation session(path);
 
 		int bucket_size = 1000;
 		int bucket_counter = 0;
 		for (const auto event : session) {
-			kernel.set_start_time((int)((event->time/60/60)+0.5)*60*60);
-			kernel.set_current_time(event->time);
 			kernel.update(*event);
 			bucket_counter++;
 			if (bucket_counter >= bucket_size) {
@@ -28,18 +38,26 @@ int main() {
 				bucket_counter = 0;
 			}
 		}
-		kernel.set_end_time((int)((kernel.current_time/60/60)+0.5)*60*60);
-
-		auto [hess,grad] = kernel.get_hessian_and_gradient();
-		std::cout << kernel.start_time << ", " << kernel.end_time << std::endl;
-		std::cout << hess << std::endl;
-		std::cout << grad << std::endl;
-		std::cout << kernel.get_params() << std::endl;
-		auto step = -hess.colPivHouseholderQr().solve(grad);
-		std::cout << step << std::endl;
-		kernel.set_params(kernel.get_params() + step);
-		std::cout << kernel.get_params() << std::endl;
-	}
+	};
+
+	//Start from the latest stored fit that ended by this session's start, so a re-run on an older day never sees a
+	//later day's fit (or its own), and store this one for the next day.
+	ParameterStore store("parameters.bin");
+	std::string key = "glbx-mdp3/PoissonKernel/12";
+	store.warm_start(kernel, key);
+
+	OptimizerOptions options;
+	options.verbose = true;
+	OptimizerResult result = Optimizer(kernel, pass, options).maximise();
+	store.save(make_fit_record(kernel, key));
+	std::cout << kernel.start_time << ", " << kernel.end_time << std::endl;
+	std::cout << result.log_likelihood << " after " << result.passes << " passes" << (result.converged ? "" : " (not converged)") << std::endl;
+	std::cout << result.params << std::endl;
+
+	//Block bootstrap within the day, each replicate warm-started from the fit.
+	EventBlock session = read_session(path);
+	BootstrapResult bootstrap = run_bootstrap(split_into_blocks(session, 60*60), []() { return std::unique_ptr<Kernel>(new PoissonKernel(12, 0, 0)); }, result.params, 200);
+	bootstrap.print(std::cout);
 
 	return 0;
 }
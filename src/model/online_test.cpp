@@ -0,0 +1,50 @@
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <cmath>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+#include "AutodiffKernel.h"
+#include "Online.h"
+
+// Feeds OnlineEstimator a stationary Poisson stream through a kernel whose statistics depend on its parameters, and
+// checks the rates settle on the truth and stay there rather than drifting in the direction of earlier steps.
+// g++ -O2 -I $EIGEN_PATH online_test.cpp && ./a.out
+int main() {
+	std::cout << std::setprecision(6);
+
+	const int num_event_types = 2;
+	const Eigen::Vector2d rates(3.0, 1.0);
+	const REAL end_time = 20000;
+
+	std::mt19937 rng(0);
+	std::exponential_distribution<double> gap_distribution(rates.sum());
+	std::discrete_distribution<int> type_distribution({rates[0], rates[1]});
+
+	AutodiffPoissonKernel kernel(num_event_types, 0, end_time);
+	kernel.set_params(Eigen::Vector2d(1.0, 1.0));
+	OnlineEstimator estimator(kernel, 500, 100);
+
+	REAL time = 0;
+	std::vector<Eigen::VectorXd> checkpoints;
+	for (REAL checkpoint = end_time / 4; checkpoint <= end_time; checkpoint += end_time / 4) {
+		while ((time += gap_distribution(rng)) < checkpoint) {
+			estimator.observe(Event(time, type_distribution(rng), Eigen::VectorXd(), 1.0));
+		}
+		checkpoints.push_back(estimator.get_params());
+		std::cout << "t=" << checkpoint << " params " << checkpoints.back().transpose() << std::endl;
+	}
+
+	bool passed = true;
+	for (size_t c = 1; c < checkpoints.size(); c++) {
+		Eigen::ArrayXd error = (checkpoints[c] - rates).array().abs() / rates.array();
+		if (error.maxCoeff() > 0.1) {
+			std::cout << "FAILED: checkpoint " << c << " is " << error.maxCoeff() * 100 << "% from the true rates" << std::endl;
+			passed = false;
+		}
+	}
+	std::cout << (passed ? "passed" : "failed") << std::endl;
+	return passed ? 0 : 1;
+}
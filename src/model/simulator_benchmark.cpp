@@ -0,0 +1,69 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cmath>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+#include "Kernel.h"
+#include "Book.h"
+#include "Simulator.h"
+
+// Measures BookSimulator throughput in simulated events per second, driven by a 12-type PoissonKernel and by a
+// StateDependentHawkesKernel, with order sizes and offsets fitted to a synthetic tape.
+// g++ -O3 -DNDEBUG -I $EIGEN_PATH simulator_benchmark.cpp
+double events_per_second(Kernel& kernel, const OrderFlowDistributions& distributions, long num_events) {
+	L2Book book(0.25);
+	long mid = book.to_tick(5000.0);
+	for (long level = 1; level <= 10; level++) {
+		book.add(BID, mid - level, 10);
+		book.add(ASK, mid + level, 10);
+	}
+	kernel.reset();
+	BookSimulator simulator(kernel, book, distributions);
+	auto start = std::chrono::steady_clock::now();
+	long simulated = simulator.run(num_events);
+	auto end = std::chrono::steady_clock::now();
+	if (simulated < num_events) {
+		std::cout << "only " << simulated << " events before end_time" << std::endl;
+	}
+	return simulated / std::chrono::duration<double>(end - start).count();
+}
+
+int main() {
+	std::cout << std::setprecision(3);
+
+	const int num_event_types = num_order_event_types;
+	const long num_events = 2000000;
+	const REAL end_time = 1e9;
+
+	//Sizes of 1 to 10 and offsets of 0 to 5 ticks from the touch for every type, against a fixed BBO.
+	OrderFlowDistributions distributions(num_event_types, 0.25);
+	std::mt19937 rng(0);
+	std::uniform_int_distribution<int> size_distribution(1, 10), offset_distribution(0, 5);
+	Eigen::VectorXd marks(NUM_BOOK_MARKS);
+	marks << 10, 5000.0 - 0.25, 10, 5000.0 + 0.25, 0, 0;
+	distributions.observe(Event(0, 0, marks, 1.0));
+	for (int i = 0; i < 100000; i++) {
+		int type = i % num_event_types;
+		int offset = offset_distribution(rng);
+		marks[ORDER_SIZE] = size_distribution(rng);
+		marks[ORDER_PRICE] = event_side(type) == BID ? marks[BID_PRICE] - 0.25 * offset : marks[ASK_PRICE] + 0.25 * offset;
+		distributions.observe(Event(i, type, marks, 1.0));
+	}
+
+	//Adds outpace cancels and trades, so the book stays populated.
+	PoissonKernel poisson(num_event_types, 0, end_time);
+	Eigen::VectorXd rates = Eigen::VectorXd::Constant(num_event_types, 1.0);
+	rates.segment(make_event_type(ADD, BID), 2).setConstant(4.0);
+	poisson.set_params(rates);
+	std::cout << "Poisson:                 " << events_per_second(poisson, distributions, num_events) / 1e6 << "M events/s" << std::endl;
+
+	BookStateDiscretiser discretiser(0.25, 4, {-0.5, 0.0, 0.5}, {5, 20});
+	StateDependentHawkesKernel hawkes(num_event_types, 0, end_time, discretiser, 10.0);
+	std::cout << "state-dependent Hawkes:  " << events_per_second(hawkes, distributions, num_events) / 1e6 << "M events/s" << std::endl;
+	return 0;
+}
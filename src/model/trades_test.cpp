@@ -0,0 +1,155 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cmath>
+
+#include <Eigen/Dense>
+
+#include "Types.h"
+#include "Packets.h"
+#include "Trades.h"
+
+// Streams a synthetic tape through TradeReconciler: a buy that sweeps two ask levels with a single trade message
+// followed by its fills and cancels, an orphan fill, an exchange event with trades on both sides, and a trade that
+// disagrees with the prior BBO and is short of fills and cancels. Checks each ClassifiedTrade, every
+// ReconciliationCounters field, and aggregate() on the same packets.
+// g++ -O2 -I $EIGEN_PATH trades_test.cpp && ./a.out
+int main() {
+	std::cout << std::setprecision(10);
+
+	std::vector<Event> events;
+	auto message = [&](REAL time, OrderAction action, BookSide side, double size, double price, double bid_size, double bid, double ask_size, double ask) {
+		Eigen::VectorXd marks(NUM_BOOK_MARKS);
+		marks[BID_SIZE] = bid_size;
+		marks[BID_PRICE] = bid;
+		marks[ASK_SIZE] = ask_size;
+		marks[ASK_PRICE] = ask;
+		marks[ORDER_SIZE] = size;
+		marks[ORDER_PRICE] = price;
+		events.emplace_back(time, make_event_type(action, side), marks, 1.0);
+	};
+	//Book before the sweep: 10 @ 99.75 / 3 @ 100.00, with 3 more at 100.25.
+	message(1, ADD, ASK, 3, 100.25, 10, 99.75, 3, 100.00);
+	//A buy of 5 takes 3 @ 100.00 and 2 @ 100.25.
+	message(2, TRADE, BID, 5, 100.00, 10, 99.75, 3, 100.00);
+	message(2, FILL, ASK, 3, 100.00, 10, 99.75, 3, 100.00);
+	message(2, FILL, ASK, 2, 100.25, 10, 99.75, 3, 100.00);
+	message(2, CANCEL, ASK, 3, 100.00, 10, 99.75, 3, 100.25);
+	message(2, CANCEL, ASK, 2, 100.25, 10, 99.75, 1, 100.25);
+	//A resting bid filled with no trade message.
+	message(3, FILL, BID, 4, 99.75, 10, 99.75, 1, 100.25);
+	message(3, CANCEL, BID, 4, 99.75, 6, 99.75, 1, 100.25);
+	//A sell of 2 and a buy of 1 in one exchange event: only the sell is kept.
+	message(4, TRADE, ASK, 2, 99.75, 6, 99.75, 1, 100.25);
+	message(4, FILL, BID, 2, 99.75, 6, 99.75, 1, 100.25);
+	message(4, TRADE, BID, 1, 100.25, 6, 99.75, 1, 100.25);
+	message(4, FILL, ASK, 1, 100.25, 6, 99.75, 1, 100.25);
+	message(4, CANCEL, BID, 2, 99.75, 4, 99.75, 1, 100.25);
+	message(4, CANCEL, ASK, 1, 100.25, 4, 99.75, 0, 100.50);
+	//A "buy" of 2 at the bid with one fill and no cancel.
+	message(5, TRADE, BID, 2, 99.75, 4, 99.75, 0, 100.50);
+	message(5, FILL, ASK, 1, 99.75, 4, 99.75, 0, 100.50);
+
+	bool passed = true;
+	auto check = [&](const std::string& name, double value, double expected) {
+		bool equal = value == expected || (std::isnan(value) && std::isnan(expected));
+		if (!equal) {
+			std::cout << name << " " << value << " expected " << expected << " FAILED" << std::endl;
+			passed = false;
+		}
+	};
+
+	struct Expected {
+		REAL time;
+		BookSide aggressor;
+		double size, first_price, last_price;
+		int levels;
+		double filled, cancelled;
+	};
+	std::vector<Expected> expected_trades = {
+		{2, BID, 5, 100.00, 100.25, 2, 5, 5},
+		{3, ASK, 4, 99.75, 99.75, 1, 4, 0},
+		{4, ASK, 2, 99.75, 99.75, 1, 2, 2},
+		{5, BID, 2, 99.75, 99.75, 1, 1, 0},
+	};
+	TradeReconciler reconciler;
+	size_t num_trades = 0;
+	auto check_trade = [&]() {
+		if (num_trades >= expected_trades.size()) {
+			std::cout << "unexpected trade FAILED" << std::endl;
+			passed = false;
+			return;
+		}
+		const ClassifiedTrade& trade = reconciler.last_trade();
+		const Expected& expected = expected_trades[num_trades];
+		std::string name = "trade " + std::to_string(num_trades);
+		std::cout << name << ": " << (trade.aggressor == BID ? "buy " : "sell ") << trade.size << " from " << trade.first_price << " to " << trade.last_price << " over " << trade.levels << " levels, filled " << trade.filled << ", cancelled " << trade.cancelled << std::endl;
+		check(name + " time", trade.time, expected.time);
+		check(name + " aggressor", trade.aggressor, expected.aggressor);
+		check(name + " size", trade.size, expected.size);
+		check(name + " first price", trade.first_price, expected.first_price);
+		check(name + " last price", trade.last_price, expected.last_price);
+		check(name + " levels", trade.levels, expected.levels);
+		check(name + " filled", trade.filled, expected.filled);
+		check(name + " cancelled", trade.cancelled, expected.cancelled);
+		num_trades++;
+	};
+	for (const Event& event : events) {
+		if (reconciler.observe(event)) {
+			check_trade();
+		}
+	}
+	if (reconciler.flush()) {
+		check_trade();
+	}
+	check("trades classified", num_trades, expected_trades.size());
+
+	const ReconciliationCounters& counters = reconciler.counters;
+	counters.print(std::cout);
+	check("trades", counters.trades, 4);
+	check("fill mismatches", counters.fill_mismatches, 1);
+	check("orphan fills", counters.orphan_fills, 1);
+	check("cancel mismatches", counters.cancel_mismatches, 1);
+	check("side disagreements", counters.side_disagreements, 1);
+	check("mixed sides", counters.mixed_sides, 1);
+
+	//Type, size and price of each packet collapsed by aggregate(); the BBO is the one after its last message.
+	struct ExpectedPacket {
+		REAL time;
+		int event_type;
+		double size, price;
+	};
+	std::vector<ExpectedPacket> expected_packets = {
+		{1, make_event_type(ADD, ASK), 3, 100.25},
+		{2, make_event_type(TRADE, BID), 5, 100.25},
+		{3, make_event_type(FILL, BID), 4, 99.75},
+		{4, make_event_type(TRADE, ASK), 2, 99.75},
+		{5, make_event_type(TRADE, BID), 2, 99.75},
+	};
+	size_t num_packets = 0;
+	Event out(0, 0, Eigen::VectorXd(NUM_BOOK_MARKS), 1.0);
+	for_each_packet(events, [&](const EventPacket& packet) {
+		if (num_packets >= expected_packets.size()) {
+			std::cout << "unexpected packet FAILED" << std::endl;
+			passed = false;
+			return;
+		}
+		aggregate(packet, out);
+		const ExpectedPacket& expected = expected_packets[num_packets];
+		const Event& closing = *(packet.end() - 1);
+		std::string name = "packet " + std::to_string(num_packets);
+		std::cout << name << ": " << packet.size() << " messages, type " << out.event_type << ", " << out.marks[ORDER_SIZE] << " @ " << out.marks[ORDER_PRICE] << std::endl;
+		check(name + " time", out.time, expected.time);
+		check(name + " type", out.event_type, expected.event_type);
+		check(name + " size", out.marks[ORDER_SIZE], expected.size);
+		check(name + " price", out.marks[ORDER_PRICE], expected.price);
+		for (int m : {BID_SIZE, BID_PRICE, ASK_SIZE, ASK_PRICE}) {
+			check(name + " book mark " + std::to_string(m), out.marks[m], closing.marks[m]);
+		}
+		num_packets++;
+	});
+	check("packets", num_packets, expected_packets.size());
+
+	std::cout << (passed ? "passed" : "failed") << std::endl;
+	return passed ? 0 : 1;
+}